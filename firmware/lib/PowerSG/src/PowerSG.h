@@ -4,3 +4,6 @@
 #include "drivers/SDriver.h"
 #include "details/control/Simple.h"
 #include "details/control/Advanced.h"
+#include "details/control/FxPlayer.h"
+#include "details/stream/Decoder.h"
+#include "details/stream/Encoder.h"
@@ -0,0 +1,10 @@
+#pragma once
+
+#if defined(__AVR__)
+#include <util/atomic.h>
+// the block runs with interrupts disabled and restores them on exit
+#define ATOMIC_SECTION ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+#else
+// host builds have no interrupts, the block runs as is
+#define ATOMIC_SECTION
+#endif
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#else
+// host builds keep constant tables in regular memory
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#endif
@@ -1,8 +1,11 @@
+#include <stddef.h>
 #include <string.h>
-#include <avr/pgmspace.h>
 
 #include "Advanced.h"
+#include "details/Atomic.h"
+#include "details/Progmem.h"
 #include "drivers/DriverHelper.h"
+#include "drivers/PDriver.h"
 
 namespace PowerSG
 {
@@ -39,20 +42,80 @@ namespace PowerSG
         raddr_t(Reg::EC_Shape)
     };
 
-    Advanced::Advanced(Driver &driver)
+    // channels of output taken by channels of PSG in stereo modes
+    const uint8_t stereo_channels[][3] PROGMEM =
+    {
+        { 0, 1, 2 }, // ABC
+        { 0, 2, 1 }, // ACB
+        { 1, 0, 2 }, // BAC
+        { 1, 2, 0 }, // BCA
+        { 2, 0, 1 }, // CAB
+        { 2, 1, 0 }, // CBA
+    };
+
+    // tone or noise bits of mixer permuted in stereo modes
+    const uint8_t stereo_mixer[][8] PROGMEM =
+    {
+        { 0b000, 0b001, 0b010, 0b011, 0b100, 0b101, 0b110, 0b111 }, // ABC
+        { 0b000, 0b001, 0b100, 0b101, 0b010, 0b011, 0b110, 0b111 }, // ACB
+        { 0b000, 0b010, 0b001, 0b011, 0b100, 0b110, 0b101, 0b111 }, // BAC
+        { 0b000, 0b100, 0b001, 0b101, 0b010, 0b110, 0b011, 0b111 }, // BCA
+        { 0b000, 0b010, 0b100, 0b110, 0b001, 0b011, 0b101, 0b111 }, // CAB
+        { 0b000, 0b100, 0b010, 0b110, 0b001, 0b101, 0b011, 0b111 }, // CBA
+    };
+
+    // registers of tone, envelope and noise periods
+    constexpr uint32_t periods_mask =
+        to_mask(Reg::A_Fine)  | to_mask(Reg::A_Coarse)  |
+        to_mask(Reg::B_Fine)  | to_mask(Reg::B_Coarse)  |
+        to_mask(Reg::C_Fine)  | to_mask(Reg::C_Coarse)  |
+        to_mask(Reg::EA_Fine) | to_mask(Reg::EA_Coarse) |
+        to_mask(Reg::EB_Fine) | to_mask(Reg::EB_Coarse) |
+        to_mask(Reg::EC_Fine) | to_mask(Reg::EC_Coarse) |
+        to_mask(Reg::N_Period);
+
+    // fine tune registers of tone and envelope periods
+    constexpr uint32_t fines_mask =
+        to_mask(Reg::A_Fine)  | to_mask(Reg::B_Fine)  | to_mask(Reg::C_Fine) |
+        to_mask(Reg::EA_Fine) | to_mask(Reg::EB_Fine) | to_mask(Reg::EC_Fine);
+
+    // registers of envelope shapes, writes restart envelopes
+    constexpr uint32_t shapes_mask =
+        to_mask(Reg::EA_Shape) | to_mask(Reg::EB_Shape) | to_mask(Reg::EC_Shape);
+
+    // registers of bank B
+    constexpr uint32_t bank_b_mask =
+        (to_mask(BankB_Lst, 1) - to_mask(BankB_Fst));
+
+    // registers of both banks but the I/O ports
+    constexpr uint32_t regs_mask =
+        (to_mask(BankB_Lst, 1) - 1) & ~(to_mask(Mode_Bank, 1) | to_mask(Mode_Bank, 2));
+
+    // clock ratio of no conversion (8.24 fixed point)
+    constexpr uint32_t ratio_one = UINT32_C(1) << 24;
+
+    AdvancedBase::AdvancedBase(Driver &driver)
         : Simple(driver)
         , m_clock(0)
-        , m_sstereo(Stereo::ABC)
-        , m_dstereo(Stereo::ABC)
+        , m_overlay()
+        , m_omask()
+        , m_ochanged(0)
+        , m_reload(0)
+        , m_mode(0)
     {}
 
-    void Advanced::reset()
+    void AdvancedBase::reset()
     {
         Simple::reset();
         memset(&m_input, 0, sizeof(state_t));
+        memset(&m_output, 0, sizeof(state_t));
+        memset(m_omask, 0, sizeof(m_omask));
+        m_ochanged = 0;
+        m_reload = 0;
+        m_mode = 0;
     }
 
-    void Advanced::setClock(Clock clock)
+    void AdvancedBase::setClock(Clock clock)
     {
         // limit the clock frequency range
         if (clock < F1_00MHZ) clock = F1_00MHZ;
@@ -63,23 +126,12 @@ namespace PowerSG
         m_clock = clock;
     }
 
-    Clock Advanced::getClock() const
+    Clock AdvancedBase::getClock() const
     {
         return m_clock;
     }
 
-    void Advanced::setStereo(Stereo stereo)
-    {
-        m_sstereo = stereo;
-        m_dstereo = stereo;
-    }
-
-    Stereo Advanced::getStereo() const
-    {
-        return m_dstereo;
-    }
-
-    void Advanced::setRegister(raddr_t addr, rdata_t data)
+    void AdvancedBase::setRegister(raddr_t addr, rdata_t data)
     {
         // set register data indirectly via bank switching
         // register address must be in range 0x00-0x0F
@@ -95,7 +147,7 @@ namespace PowerSG
         }
     }
 
-    void Advanced::getRegister(raddr_t addr, rdata_t &data) const
+    void AdvancedBase::getRegister(raddr_t addr, rdata_t &data) const
     {
         // get register data indirectly via bank switching
         // register address must be in range 0x00-0x0F
@@ -111,37 +163,141 @@ namespace PowerSG
         }
     }
 
-    void Advanced::setRegister(Reg reg, rdata_t data)
+    void AdvancedBase::setRegister(Reg reg, rdata_t data)
     {
         // set register data directly
         set_register(m_input, reg, data);
     }
 
-    void Advanced::getRegister(Reg reg, rdata_t &data) const
+    void AdvancedBase::getRegister(Reg reg, rdata_t &data) const
     {
         // get register data directly
         get_register(m_input, reg, data);
     }
 
-    void Advanced::update()
+    void AdvancedBase::setOverlay(Reg reg, rdata_t data, rdata_t mask)
     {
-        if (m_input.status.changed)
+        raddr_t addr = raddr_t(reg);
+        if (addr >= Mode_Bank) return;
+
+        rdata_t overlay = ((m_overlay[addr] & ~mask) | (data & mask));
+        if (overlay != m_overlay[addr] || (m_omask[addr] & mask) != mask)
         {
-            // copy input state to output and reset changes
-            memcpy(&m_output, &m_input, sizeof(state_t));
-            m_input.status.changed = 0;
-
-            // process outout state and write to PSG
-            process_clock_conversion();
-            process_channels_remapping();
-            process_compatible_mode_fix();
-            
-            check_output_changes();
-            write_output_to_chip();
+            m_overlay[addr] = overlay;
+            m_omask[addr] |= mask;
+            m_ochanged |= to_mask(addr);
         }
     }
 
-    void Advanced::set_register(state_t &state, Reg reg, rdata_t data)
+    void AdvancedBase::clearOverlay(Reg reg, rdata_t mask)
+    {
+        raddr_t addr = raddr_t(reg);
+        if (addr >= Mode_Bank || !(m_omask[addr] & mask)) return;
+
+        // the register is written again with the input bits
+        m_omask[addr] &= ~mask;
+        m_ochanged |= to_mask(addr);
+    }
+
+    rdata_t AdvancedBase::getChipMode() const
+    {
+        return m_mode;
+    }
+
+    uint32_t AdvancedBase::pending_changes(bool overlay) const
+    {
+        // registers to be latched, none unless there are changes
+        // of the input, or the overlay ones go without the input
+        bool pending = (m_input.status.changed != 0);
+        bool forced = (m_ochanged || m_reload);
+        if (overlay ? (!forced || pending) : (!pending && !forced)) return 0;
+
+        uint32_t mask = (m_input.status.changed | m_ochanged | m_reload);
+
+        // registers of bank B are not written out of exp mode
+        if (m_input.status.exp_mode && !m_output.status.exp_mode)
+            mask |= bank_b_mask;
+        return mask;
+    }
+
+    void AdvancedBase::latch_changes(uint32_t mask)
+    {
+        // copy changed registers from input to output,
+        // the rest of output keeps the processed data
+        const rdata_t* src = reinterpret_cast<const rdata_t*>(&m_input);
+        rdata_t* dst = reinterpret_cast<rdata_t*>(&m_output);
+        raddr_t addr = BankA_Fst;
+        for (uint32_t bits = mask; bits; bits >>= 1, ++addr)
+        {
+            if (!(bits & 1)) continue;
+            uint8_t offset = field_offset(Reg(addr));
+            if (offset != No_Field) dst[offset] = src[offset];
+        }
+        m_output.status.exp_mode = m_input.status.exp_mode;
+        m_output.status.changed = mask;
+
+        // reset changes
+        m_input.status.changed = 0;
+        m_ochanged = 0;
+        m_reload = 0;
+    }
+
+    void AdvancedBase::process_overlay()
+    {
+        // bits of the overlay replace those of the input
+        rdata_t data; raddr_t addr = BankA_Fst;
+        for (uint32_t bits = m_output.status.changed; bits && addr < Mode_Bank; bits >>= 1, ++addr)
+        {
+            if (!(bits & 1) || !m_omask[addr]) continue;
+            get_register(m_output, Reg(addr), data);
+            data = ((data & ~m_omask[addr]) | (m_overlay[addr] & m_omask[addr]));
+            set_register(m_output, Reg(addr), data);
+        }
+    }
+
+    uint8_t AdvancedBase::field_offset(Reg reg)
+    {
+        // offsets of fields of the state for registers,
+        // the I/O ports 0x0E and 0x0F have no fields
+        static const uint8_t offsets[] PROGMEM =
+        {
+            // bank A
+            offsetof(state_t, channels[0].t_period.fine),   // A_Fine
+            offsetof(state_t, channels[0].t_period.coarse), // A_Coarse
+            offsetof(state_t, channels[1].t_period.fine),   // B_Fine
+            offsetof(state_t, channels[1].t_period.coarse), // B_Coarse
+            offsetof(state_t, channels[2].t_period.fine),   // C_Fine
+            offsetof(state_t, channels[2].t_period.coarse), // C_Coarse
+            offsetof(state_t, commons.n_period),            // N_Period
+            offsetof(state_t, commons.mixer),               // Mixer
+            offsetof(state_t, channels[0].t_volume),        // A_Volume
+            offsetof(state_t, channels[1].t_volume),        // B_Volume
+            offsetof(state_t, channels[2].t_volume),        // C_Volume
+            offsetof(state_t, channels[0].e_period.fine),   // EA_Fine
+            offsetof(state_t, channels[0].e_period.coarse), // EA_Coarse
+            offsetof(state_t, channels[0].e_shape),         // EA_Shape
+            No_Field, No_Field,
+
+            // bank B
+            offsetof(state_t, channels[1].e_period.fine),   // EB_Fine
+            offsetof(state_t, channels[1].e_period.coarse), // EB_Coarse
+            offsetof(state_t, channels[2].e_period.fine),   // EC_Fine
+            offsetof(state_t, channels[2].e_period.coarse), // EC_Coarse
+            offsetof(state_t, channels[1].e_shape),         // EB_Shape
+            offsetof(state_t, channels[2].e_shape),         // EC_Shape
+            offsetof(state_t, channels[0].t_duty),          // A_Duty
+            offsetof(state_t, channels[1].t_duty),          // B_Duty
+            offsetof(state_t, channels[2].t_duty),          // C_Duty
+            offsetof(state_t, commons.n_and_mask),          // N_AndMask
+            offsetof(state_t, commons.n_or_mask),           // N_OrMask
+        };
+        static_assert(sizeof(offsets) == BankB_Lst + 1, "register map is incomplete");
+
+        raddr_t addr = raddr_t(reg);
+        return (addr <= BankB_Lst ? pgm_read_byte(offsets + addr) : uint8_t(No_Field));
+    }
+
+    void AdvancedBase::set_register(state_t &state, Reg reg, rdata_t data)
     {
         // preserve the state of exp mode and bank of regs
         // separately from the shape of channel A envelope
@@ -152,76 +308,21 @@ namespace PowerSG
         }
 
         // map register to corresponding field of state
-        switch(reg)
+        uint8_t offset = field_offset(reg);
+        if (offset != No_Field)
         {
-            // bank A
-            case Reg::A_Fine:    state.channels[0].t_period.fine = data; break;
-            case Reg::A_Coarse:  state.channels[0].t_period.coarse = data; break;
-            case Reg::B_Fine:    state.channels[1].t_period.fine = data; break;
-            case Reg::B_Coarse:  state.channels[1].t_period.coarse = data; break;
-            case Reg::C_Fine:    state.channels[2].t_period.fine = data; break;
-            case Reg::C_Coarse:  state.channels[2].t_period.coarse = data; break;
-            case Reg::N_Period:  state.commons.n_period = data; break;
-            case Reg::Mixer:     state.commons.mixer = data; break;
-            case Reg::A_Volume:  state.channels[0].t_volume = data; break;
-            case Reg::B_Volume:  state.channels[1].t_volume = data; break;
-            case Reg::C_Volume:  state.channels[2].t_volume = data; break;
-            case Reg::EA_Fine:   state.channels[0].e_period.fine = data; break;
-            case Reg::EA_Coarse: state.channels[0].e_period.coarse = data; break;
-            case Reg::EA_Shape:  state.channels[0].e_shape = data; break;
-
-            // bank B
-            case Reg::EB_Fine:   state.channels[1].e_period.fine = data; break;
-            case Reg::EB_Coarse: state.channels[1].e_period.coarse = data; break;
-            case Reg::EC_Fine:   state.channels[2].e_period.fine = data; break;
-            case Reg::EC_Coarse: state.channels[2].e_period.coarse = data; break;
-            case Reg::EB_Shape:  state.channels[1].e_shape = data; break;
-            case Reg::EC_Shape:  state.channels[2].e_shape = data; break;
-            case Reg::A_Duty:    state.channels[0].t_duty = data; break;
-            case Reg::B_Duty:    state.channels[1].t_duty = data; break;
-            case Reg::C_Duty:    state.channels[2].t_duty = data; break;
-            case Reg::N_AndMask: state.commons.n_and_mask = data; break;
-            case Reg::N_OrMask:  state.commons.n_or_mask = data; break;
+            reinterpret_cast<rdata_t*>(&state)[offset] = data;
         }
 
         // mark register as changed
         state.status.changed |= to_mask(reg);
     }
 
-    void Advanced::get_register(const state_t &state, Reg reg, rdata_t &data) const
+    void AdvancedBase::get_register(const state_t &state, Reg reg, rdata_t &data) const
     {
         // map register to corresponding field of state
-        switch(reg)
-        {
-            // bank A
-            case Reg::A_Fine:    data = state.channels[0].t_period.fine; break;
-            case Reg::A_Coarse:  data = state.channels[0].t_period.coarse; break;
-            case Reg::B_Fine:    data = state.channels[1].t_period.fine; break;
-            case Reg::B_Coarse:  data = state.channels[1].t_period.coarse; break;
-            case Reg::C_Fine:    data = state.channels[2].t_period.fine; break;
-            case Reg::C_Coarse:  data = state.channels[2].t_period.coarse; break;
-            case Reg::N_Period:  data = state.commons.n_period; break;
-            case Reg::Mixer:     data = state.commons.mixer; break;
-            case Reg::A_Volume:  data = state.channels[0].t_volume; break;
-            case Reg::B_Volume:  data = state.channels[1].t_volume; break;
-            case Reg::C_Volume:  data = state.channels[2].t_volume; break;
-            case Reg::EA_Fine:   data = state.channels[0].e_period.fine; break;
-            case Reg::EA_Coarse: data = state.channels[0].e_period.coarse; break;
-            case Reg::EA_Shape:  data = state.channels[0].e_shape; break;
-
-            // bank B
-            case Reg::EB_Fine:   data = state.channels[1].e_period.fine; break;
-            case Reg::EB_Coarse: data = state.channels[1].e_period.coarse; break;
-            case Reg::EC_Fine:   data = state.channels[2].e_period.fine; break;
-            case Reg::EC_Coarse: data = state.channels[2].e_period.coarse; break;
-            case Reg::EB_Shape:  data = state.channels[1].e_shape; break;
-            case Reg::EC_Shape:  data = state.channels[2].e_shape; break;
-            case Reg::A_Duty:    data = state.channels[0].t_duty; break;
-            case Reg::B_Duty:    data = state.channels[1].t_duty; break;
-            case Reg::C_Duty:    data = state.channels[2].t_duty; break;
-            case Reg::N_AndMask: data = state.commons.n_and_mask; break;
-            case Reg::N_OrMask:  data = state.commons.n_or_mask; break;
-        }
+        uint8_t offset = field_offset(reg);
+        data = (offset != No_Field ? reinterpret_cast<const rdata_t*>(&state)[offset] : 0);
 
         // combine the current state of exp mode and bank
         // of regs with the shape of channel A envelope
@@ -231,218 +332,441 @@ namespace PowerSG
         }
     }
 
-    void Advanced::process_clock_conversion()
+    rdata_t AdvancedBase::output_register(raddr_t addr, raddr_t src) const
     {
-    #ifndef DISABLE_CLOCK_CONVERSION
-        const Clock vclock = getClock();
-        const Clock rclock = Simple::getClock();
+        rdata_t data;
+        get_register(m_output, Reg(src), data);
+
+        // shape goes along with the current mode, the PSG is
+        // left on bank A, bank B is selected for its writes only
+        if (src == Mode_Bank) data &= 0x0F;
+        if (addr == Mode_Bank) data = ((data & 0x0F) | (m_output.status.exp_mode & ~0x10));
+        return data;
+    }
 
-        if (rclock != vclock)
-        {
-            rpair_t t_bound = (m_output.status.exp_mode ? 0xFFFF : 0x0FFF);
-            rpair_t n_bound = (m_output.status.exp_mode ? 0x00FF : 0x001F);
+    AdvancedBase::conversion_t::conversion_t()
+        : m_ratio(ratio_one)
+    {}
 
-            // safe period conversion based on clock ratio
-            const auto convert_period = [&](rpair_t& period, rpair_t bound)
-            {
-                uint32_t converted = ((period * (rclock >> 5) / (vclock >> 6) + 1) >> 1);
-                period = rpair_t(converted > bound ? bound : converted);
-            };
+    void AdvancedBase::conversion_t::reset_conversion(const AdvancedBase& psg)
+    {
+        // the ratio follows the clocks, rounding starts over
+        set_ratio(psg);
+    #ifdef ENABLE_CONVERSION_CARRY
+        for (auto& error : m_cerror) error = 0x8000;
+    #endif
+    }
 
-            // convert tone and envelope periods
-            for (int i = 0; i < 3; ++i)
+    bool AdvancedBase::conversion_t::set_ratio(const AdvancedBase& psg)
+    {
+        // the real clock may differ from the requested one
+        const Clock vclock = psg.AdvancedBase::getClock();
+        const Clock rclock = psg.Simple::getClock();
+
+        uint32_t ratio = ratio_one;
+        if (rclock && vclock && rclock != vclock)
+        {
+            // long division of clocks to 8.24 fixed point ratio,
+            // done once here so periods need no division at all
+            uint32_t rem = (rclock % vclock);
+            ratio = (rclock / vclock);
+            for (uint8_t i = 0; i < 3; ++i)
             {
-                convert_period(m_output.channels[i].t_period.full, t_bound);
-                convert_period(m_output.channels[i].e_period.full, 0xFFFF);
+                rem <<= 8;
+                ratio = ((ratio << 8) | (rem / vclock));
+                rem %= vclock;
             }
-            m_output.status.changed |= 0b01100001111111; // hack
-
-            // convert noise period
-            rpair_t period = m_output.commons.n_period;
-            convert_period(period, n_bound);
-            m_output.commons.n_period = rdata_t(period);
+            if (2 * rem >= vclock) ratio++;
         }
+
+        if (ratio == m_ratio) return false;
+
+        // periods must be converted and written again
+        m_ratio = ratio;
+    #ifdef ENABLE_CONVERSION_CARRY
+        for (auto& error : m_cerror) error = 0x8000;
     #endif
+        return true;
     }
 
-    void Advanced::process_channels_remapping()
+    uint32_t AdvancedBase::conversion_t::latch_mask(const AdvancedBase& psg, uint32_t mask) const
     {
-    #ifndef DISABLE_CHANNELS_REMAPPING
-        // restrict stereo modes available for exp mode
-        m_dstereo = (m_output.status.exp_mode && m_sstereo != Stereo::ABC && m_sstereo != Stereo::ACB)
-            ? Stereo::ABC
-            : m_sstereo;
+        if (m_ratio != ratio_one)
+        {
+            // bounds of converted periods depend on exp mode
+            if (psg.m_input.status.exp_mode != psg.m_output.status.exp_mode)
+                mask |= periods_mask;
+
+            // periods are converted as a whole, so both
+            // registers of the changed period are taken
+            uint32_t pairs = ((mask | (mask >> 1)) & fines_mask);
+            mask |= (pairs | (pairs << 1));
+        }
+        return mask;
+    }
 
-        if (m_dstereo != Stereo::ABC)
+    void AdvancedBase::conversion_t::convert(AdvancedBase& psg)
+    {
+        if (m_ratio != ratio_one)
         {
-            const auto swap_register = [&](raddr_t reg_l, raddr_t reg_r)
+            state_t& output = psg.m_output;
+            const uint32_t changed = output.status.changed;
+            rpair_t t_bound = (output.status.exp_mode ? 0xFFFF : 0x0FFF);
+            rpair_t n_bound = (output.status.exp_mode ? 0x00FF : 0x001F);
+            uint8_t  r_whole = uint8_t(m_ratio >> 24);
+            uint16_t r_frac_h = uint16_t(m_ratio >> 8);
+            uint8_t  r_frac_l = uint8_t(m_ratio);
+
+            // convert the period by multiplying it with the clock ratio
+            const auto convert_period = [&](uint8_t idx, rpair_t& period, rpair_t bound)
             {
-                rdata_t data_l, data_r;
-                get_register(m_output, Reg(reg_l), data_l);
-                get_register(m_output, Reg(reg_r), data_r);
-                set_register(m_output, Reg(reg_l), data_r);
-                set_register(m_output, Reg(reg_r), data_l);
+                // fraction of the result in 16.16 fixed point,
+                // it's made of two narrow multiplications
+                uint32_t frac = (uint32_t(period) * r_frac_h);
+                frac += ((uint32_t(period) * r_frac_l) >> 8);
+            #ifdef ENABLE_CONVERSION_CARRY
+                // carry the rounding error to the next conversion
+                frac += m_cerror[idx];
+                m_cerror[idx] = uint16_t(frac);
+            #else
+                frac += 0x8000; (void)idx;
+            #endif
+                uint32_t converted = (uint32_t(period) * r_whole + (frac >> 16));
+                period = rpair_t(converted > bound ? bound : converted);
             };
 
-            const auto swap_channels = [&](raddr_t l, raddr_t r)
+            // convert changed tone and envelope periods, both
+            // registers of a period are latched at once
+            for (uint8_t i = 0; i < 3; ++i)
             {
-                // swap tone period and tone volume/envelope enable
-                swap_register(raddr_t(Reg::A_Fine) + 2 * l, raddr_t(Reg::A_Fine) + 2 * r);
-                swap_register(raddr_t(Reg::A_Coarse) + 2 * l, raddr_t(Reg::A_Coarse) + 2 * r);
-                swap_register(raddr_t(Reg::A_Volume) + l, raddr_t(Reg::A_Volume) + r);
+                if (changed & to_mask(Reg::A_Fine, 2 * i))
+                    convert_period(0 + i, output.channels[i].t_period.full, t_bound);
+                if (changed & to_mask(pgm_read_byte(e_fine + i)))
+                    convert_period(3 + i, output.channels[i].e_period.full, 0xFFFF);
+            }
 
-                if (m_output.status.exp_mode)
-                {
-                    // swap tone duty cycle and envelope period
-                    swap_register(raddr_t(Reg::A_Duty) + l, raddr_t(Reg::A_Duty) + r);
-                    swap_register(pgm_read_byte(e_fine + l), pgm_read_byte(e_fine + r));
-                    swap_register(pgm_read_byte(e_coarse + l), pgm_read_byte(e_coarse + r));
-
-                    // swap envelope shape
-                    raddr_t shape_l = pgm_read_byte(e_shape + l);
-                    raddr_t shape_r = pgm_read_byte(e_shape + r);
-                    bool schanged_l = (m_output.status.changed & to_mask(shape_l));
-                    bool schanged_r = (m_output.status.changed & to_mask(shape_r));
-                    swap_register(shape_l, shape_r);
-                    if (schanged_l) m_output.status.changed |= to_mask(shape_r);
-                    else m_output.status.changed &= ~to_mask(shape_r);
-                    if (schanged_r) m_output.status.changed |= to_mask(shape_l);
-                    else m_output.status.changed &= ~to_mask(shape_l);
-                }
+            // convert changed noise period
+            if (changed & to_mask(Reg::N_Period))
+            {
+                rpair_t period = output.commons.n_period;
+                convert_period(6, period, n_bound);
+                output.commons.n_period = rdata_t(period);
+            }
+        }
+    }
 
-                // swap bits in mixer register
-                rdata_t msk_l = (0b00001001 << l);
-                rdata_t msk_r = (0b00001001 << r);
-                rdata_t mix_l = ((m_output.commons.mixer & msk_l) >> l);
-                rdata_t mix_r = ((m_output.commons.mixer & msk_r) >> r);
-                res_bits(m_output.commons.mixer, msk_l | msk_r);
-                set_bits(m_output.commons.mixer, mix_l << r);
-                set_bits(m_output.commons.mixer, mix_r << l);
-            };
+    AdvancedBase::remapping_t::remapping_t()
+        : m_stereo(Stereo::ABC)
+    {
+        reset_remap();
+    }
 
-            // swap channels in pairs
-            switch(m_dstereo)
-            {
-            case Stereo::ACB:
-                swap_channels(1, 2); // B <-> C
-                break;
+    void AdvancedBase::remapping_t::reset_remap()
+    {
+        // the map of the stereo mode out of exp mode, as
+        // the output state is clear and PSG is just reset
+        m_rstereo = m_stereo;
+        m_rexp = false;
+        build_map(false);
+    }
 
-            case Stereo::BAC:
-                swap_channels(0, 1); // A <-> B
-                break;
+    void AdvancedBase::remapping_t::remap(AdvancedBase& psg)
+    {
+        // envelopes and duty cycles belong to channels in exp mode only
+        bool exp = (psg.m_output.status.exp_mode && psg.getChipId() == ChipId::AY8930);
+        if (m_stereo != m_rstereo || exp != m_rexp)
+        {
+            m_rstereo = m_stereo;
+            m_rexp = exp;
 
-            case Stereo::BCA:
-                swap_channels(0, 1); // A <-> B
-                swap_channels(1, 2); // B <-> C
-                break;
+            raddr_t rmap[BankB_Lst + 1];
+            memcpy(rmap, m_rmap, sizeof(rmap));
+            if (build_map(exp))
+            {
+                // registers of channels are written again in the new
+                // order, envelope shapes only if the shape moved to the
+                // register differs from the one it had (or may differ),
+                // as the write restarts the envelope
+                state_t& output = psg.m_output;
+                uint32_t changed = (regs_mask & ~shapes_mask);
+                for (uint8_t i = 0; i < 3; ++i)
+                {
+                    raddr_t addr = pgm_read_byte(e_shape + i);
+                    raddr_t prev = rmap[addr], next = m_rmap[addr];
+                    if (prev == next) continue;
+
+                    rdata_t prev_shape, next_shape;
+                    psg.get_register(output, Reg(prev), prev_shape);
+                    psg.get_register(output, Reg(next), next_shape);
+                    if (((prev_shape ^ next_shape) & 0x0F) || (output.status.changed & to_mask(prev)))
+                        changed |= to_mask(next);
+                }
+                output.status.changed |= changed;
+            }
+        }
+    }
 
-            case Stereo::CAB:
-                swap_channels(1, 2); // B <-> C
-                swap_channels(0, 1); // A <-> B
-                break;
+    bool AdvancedBase::remapping_t::build_map(bool exp)
+    {
+        // gather registers of output for registers of PSG
+        raddr_t rmap[BankB_Lst + 1];
+        for (raddr_t addr = BankA_Fst; addr <= BankB_Lst; ++addr)
+            rmap[addr] = addr;
 
-            case Stereo::CBA:
-                swap_channels(0, 2); // A <-> C
-                break;
+        const uint8_t* channels = stereo_channels[uint8_t(m_rstereo)];
+        for (uint8_t i = 0; i < 3; ++i)
+        {
+            uint8_t ch = pgm_read_byte(channels + i);
+            rmap[raddr_t(Reg::A_Fine) + 2 * i] = (raddr_t(Reg::A_Fine) + 2 * ch);
+            rmap[raddr_t(Reg::A_Coarse) + 2 * i] = (raddr_t(Reg::A_Coarse) + 2 * ch);
+            rmap[raddr_t(Reg::A_Volume) + i] = (raddr_t(Reg::A_Volume) + ch);
 
-            default: break;
+            if (exp)
+            {
+                rmap[raddr_t(Reg::A_Duty) + i] = (raddr_t(Reg::A_Duty) + ch);
+                rmap[pgm_read_byte(e_fine + i)] = pgm_read_byte(e_fine + ch);
+                rmap[pgm_read_byte(e_coarse + i)] = pgm_read_byte(e_coarse + ch);
+                rmap[pgm_read_byte(e_shape + i)] = pgm_read_byte(e_shape + ch);
             }
         }
-    #endif
+
+        if (memcmp(rmap, m_rmap, sizeof(rmap)) == 0) return false;
+        memcpy(m_rmap, rmap, sizeof(rmap));
+        return true;
     }
 
-    void Advanced::process_compatible_mode_fix()
+    rdata_t AdvancedBase::remapping_t::remap_mixer(rdata_t data) const
     {
-    #ifndef DISABLE_COMPATIBLE_MODE_FIX
-        if (getChipId() == ChipId::AY8930)
+        // permute tone and noise bits of channels
+        const uint8_t* mixer = stereo_mixer[uint8_t(m_rstereo)];
+        rdata_t t_bits = pgm_read_byte(mixer + (data & 0x07));
+        rdata_t n_bits = pgm_read_byte(mixer + ((data >> 3) & 0x07));
+        return ((data & 0xC0) | (n_bits << 3) | t_bits);
+    }
+
+    void AdvancedBase::mode_fix_t::fix(AdvancedBase& psg)
+    {
+        if (psg.getChipId() == ChipId::AY8930)
         {
-            for (int i = 0; i < 3; ++i)
+            // mixer and mode changes affect all the channels
+            state_t& output = psg.m_output;
+            const uint32_t changed = output.status.changed;
+            bool all = (changed & (to_mask(Reg::Mixer) | to_mask(Reg::Mode_Bank)));
+
+            for (uint8_t i = 0; i < 3; ++i)
             {
-                rdata_t volume = m_output.channels[i].t_volume;
-                if (m_output.status.exp_mode) volume >>= 1;
+                if (!all && !(changed & to_mask(Reg::A_Volume, i))) continue;
+
+                rdata_t volume = output.channels[i].t_volume;
+                if (output.status.exp_mode) volume >>= 1;
 
                 // get tone, noise and envelope enable flags
-                bool t_disable = isb_set(m_output.commons.mixer, 0 + i);
-                bool n_disable = isb_set(m_output.commons.mixer, 3 + i);
+                bool t_disable = isb_set(output.commons.mixer, 0 + i);
+                bool n_disable = isb_set(output.commons.mixer, 3 + i);
                 bool e_enable  = isb_set(volume, 4);
 
-                // special case - pure envelope
-                if (e_enable && t_disable && n_disable)
+                // special case - pure envelope, fixed by enabling inaudible
+                // tone on write, so tone registers are written on its change
+                bool fixed = (e_enable && t_disable && n_disable);
+                if (fixed != isb_set(m_fixed, i))
                 {
-                    // fix by enabling inaudible tone
-                    m_output.channels[i].t_period.full = 0;
-                    m_output.channels[i].t_duty = 0x08;
-                    res_bit(m_output.commons.mixer, 0 + i);
+                    m_fixed ^= (1 << i);
+                    output.status.changed |= (
+                        to_mask(Reg::A_Fine, 2 * i) | to_mask(Reg::A_Coarse, 2 * i) |
+                        to_mask(Reg::A_Duty, i) | to_mask(Reg::Mixer));
                 }
             }
         }
-    #endif    
     }
 
-    void Advanced::check_output_changes()
+    rdata_t AdvancedBase::mode_fix_t::fix_register(raddr_t src, rdata_t data) const
     {
-        // apply changes in registers made by processing
-        rdata_t i_data, o_data;
-        for (raddr_t addr = BankA_Fst; addr <= BankB_Lst; ++addr)
+        // tone of the fixed channel is inaudible
+        if (m_fixed)
         {
-            get_register(m_input,  Reg(addr), i_data);
-            get_register(m_output, Reg(addr), o_data);
+            if (src <= raddr_t(Reg::C_Coarse) && isb_set(m_fixed, src >> 1))
+                data = 0;
+            if (src >= raddr_t(Reg::A_Duty) && src <= raddr_t(Reg::C_Duty) && isb_set(m_fixed, src - raddr_t(Reg::A_Duty)))
+                data = 0x08;
+        }
+        return data;
+    }
 
-            if (i_data != o_data)
-                m_output.status.changed |= to_mask(addr);
+    template<uint8_t Stages, class Bus>
+    StagedAdvanced<Stages, Bus>::StagedAdvanced(Bus &driver)
+        : AdvancedBase(driver)
+        , m_bus(driver)
+    {}
+
+    template<uint8_t Stages, class Bus>
+    void StagedAdvanced<Stages, Bus>::reset()
+    {
+        // stages start over along with the states
+        AdvancedBase::reset();
+        this->reset_conversion(*this);
+        this->reset_remap();
+        this->reset_fix();
+    }
+
+    template<uint8_t Stages, class Bus>
+    void StagedAdvanced<Stages, Bus>::setClock(Clock clock)
+    {
+        AdvancedBase::setClock(clock);
+        if (this->set_ratio(*this)) m_reload |= periods_mask;
+    }
+
+    template<uint8_t Stages, class Bus>
+    void StagedAdvanced<Stages, Bus>::update()
+    {
+        if (latch_input(false)) process_output();
+    }
+
+    template<uint8_t Stages, class Bus>
+    void StagedAdvanced<Stages, Bus>::updateOverlay()
+    {
+        if (latch_input(true)) process_output();
+    }
+
+    template<uint8_t Stages, class Bus>
+    bool StagedAdvanced<Stages, Bus>::latch_input(bool overlay)
+    {
+        // latch input changes, the input state may be written by
+        // the stream interrupt while the output is being processed
+        bool changed = false;
+        ATOMIC_SECTION
+        {
+            uint32_t mask = pending_changes(overlay);
+            if (mask)
+            {
+                latch_changes(this->latch_mask(*this, mask));
+                changed = true;
+            }
         }
+        return changed;
     }
 
-    void Advanced::write_output_to_chip()
+    template<uint8_t Stages, class Bus>
+    void StagedAdvanced<Stages, Bus>::process_output()
+    {
+        // process changes of output state and write them to PSG,
+        // each stage marks what it changes, stages off the list
+        // are empty and leave nothing behind
+        process_overlay();
+        this->convert(*this);
+        this->remap(*this);
+        this->fix(*this);
+
+        write_output_to_chip();
+        flush();
+    }
+
+    template<uint8_t Stages, class Bus>
+    rdata_t StagedAdvanced<Stages, Bus>::output_register(raddr_t addr, raddr_t src) const
+    {
+        rdata_t data = AdvancedBase::output_register(addr, src);
+        data = this->fix_register(src, data);
+
+        // tone of the fixed channels is enabled before
+        // tone and noise bits of channels are permuted
+        if (addr == raddr_t(Reg::Mixer))
+            data = this->remap_mixer(this->fix_mixer(data));
+        return data;
+    }
+
+    template<uint8_t Stages, class Bus>
+    void StagedAdvanced<Stages, Bus>::write_mode_bank(rdata_t data)
+    {
+        // the mode is kept along with the write, so that the
+        // envelope shape written by interrupts keeps it as well
+        ATOMIC_SECTION
+        {
+            writeRegister(Mode_Bank, data);
+            m_mode = (data & 0xF0);
+        }
+    }
+
+    template<uint8_t Stages, class Bus>
+    void StagedAdvanced<Stages, Bus>::write_output_to_chip()
     {
         // write changes in output state to the PSG
-        rdata_t data; bool switch_banks = false;
+        const uint32_t changed = m_output.status.changed;
+        bool switch_banks = false;
         if (this->getChipId() == ChipId::AY8930 && m_output.status.exp_mode)
         {
-            // check for changes in registers of bank B
-            for (raddr_t addr = BankB_Fst; addr <= BankB_Lst; ++addr)
+            // bank B stays selected within the section only, so
+            // interrupts writing bank A never reach its registers
+            ATOMIC_SECTION
             {
-                if (m_output.status.changed & to_mask(addr))
+                // check for changes in registers of bank B
+                for (raddr_t addr = BankB_Fst; addr <= BankB_Lst; ++addr)
                 {
-                    // we have changes, so first
-                    // of all we switch to bank B
-                    if (!switch_banks)
+                    raddr_t src = this->source_register(addr);
+                    if (changed & to_mask(src))
                     {
-                        switch_banks = true;
-                        get_register(m_output, Reg::Mode_Bank, data);
-                        data &= 0x0F; data |= 0xB0;
-                        Simple::setRegister(Mode_Bank, data);
+                        // we have changes, so first
+                        // of all we switch to bank B
+                        if (!switch_banks)
+                        {
+                            switch_banks = true;
+                            rdata_t data = output_register(Mode_Bank, this->source_register(Mode_Bank));
+                            data &= 0x0F; data |= 0xB0;
+                            write_mode_bank(data);
+                        }
+
+                        // send register data to chip (within bank B)
+                        writeRegister(addr & 0x0F, output_register(addr, src));
                     }
-
-                    // send register data to chip (within bank B)
-                    get_register(m_output, Reg(addr), data);
-                    Simple::setRegister(addr & 0x0F, data);
                 }
-            }
 
-            if (switch_banks)
-            {
-                // we wrote something to bank B,
-                // so we switch back to bank A
-                get_register(m_output, Reg::Mode_Bank, data);
-                data &= 0x0F; data |= 0xA0;
-                Simple::setRegister(Mode_Bank, data);
+                if (switch_banks)
+                {
+                    // we wrote something to bank B,
+                    // so we switch back to bank A
+                    rdata_t data = output_register(Mode_Bank, this->source_register(Mode_Bank));
+                    data &= 0x0F; data |= 0xA0;
+                    write_mode_bank(data);
+                }
             }
         }
 
         // check for changes in registers of bank A
         for (raddr_t addr = BankA_Fst; addr <= BankA_Lst; ++addr)
         {
-            if (m_output.status.changed & to_mask(addr))
+            raddr_t src = this->source_register(addr);
+            if (changed & to_mask(src))
             {
                 // skip the 'mode/bank' register if 
                 // we've done a bank switch before
                 if (switch_banks && addr == Mode_Bank) continue;
 
                 // send register data to chip (within bank A)
-                get_register(m_output, Reg(addr), data);
-                Simple::setRegister(addr & 0x0F, data);
+                rdata_t data = output_register(addr, src);
+                if (addr == Mode_Bank) write_mode_bank(data);
+                else writeRegister(addr & 0x0F, data);
             }
         }
     }
+
+    // pipelines of all the lists of stages, only
+    // those of constructed instances are linked
+    template class StagedAdvanced<0>;
+    template class StagedAdvanced<1>;
+    template class StagedAdvanced<2>;
+    template class StagedAdvanced<3>;
+    template class StagedAdvanced<4>;
+    template class StagedAdvanced<5>;
+    template class StagedAdvanced<6>;
+    template class StagedAdvanced<7>;
+
+#ifdef USE_M328_PDRIVER
+    // and the same bound to the board driver
+    template class StagedAdvanced<0, PDriver>;
+    template class StagedAdvanced<1, PDriver>;
+    template class StagedAdvanced<2, PDriver>;
+    template class StagedAdvanced<3, PDriver>;
+    template class StagedAdvanced<4, PDriver>;
+    template class StagedAdvanced<5, PDriver>;
+    template class StagedAdvanced<6, PDriver>;
+    template class StagedAdvanced<7, PDriver>;
+#endif
 }
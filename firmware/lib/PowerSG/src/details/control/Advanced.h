@@ -2,9 +2,7 @@
 
 #include "Simple.h"
 
-//#define DISABLE_CLOCK_CONVERSION
-//#define DISABLE_CHANNELS_REMAPPING
-//#define DISABLE_COMPATIBLE_MODE_FIX
+//#define ENABLE_CONVERSION_CARRY
 
 namespace PowerSG
 {
@@ -69,10 +67,22 @@ namespace PowerSG
         BankB_Lst = raddr_t(Reg::N_OrMask)  // numeric value of the last register in bank B
     };
 
+    enum
+    {
+        Clock_Conversion    = 0x01, // periods converted to the real clock
+        Channels_Remapping  = 0x02, // channels reordered by stereo mode
+        Compatible_Mode_Fix = 0x04, // pure envelopes fixed on AY8930
+        All_Stages          = 0x07  // list of all the pipeline stages
+    };
+
     using rpair_t = uint16_t;
 
-    class Advanced : public Simple
+    // part of the pipeline shared by all the lists of stages:
+    // input, overlay and output states, their registers and the
+    // stages as policies, on and off, picked by StagedAdvanced
+    class AdvancedBase : public Simple
     {
+    protected:
         union period_t
         {
             rpair_t full;
@@ -110,37 +120,208 @@ namespace PowerSG
         };
 
     public:
-        Advanced(Driver& driver);
+        AdvancedBase(Driver& driver);
         void reset() override;
  
         void setClock(Clock clock) override;
         Clock getClock() const override;
 
-        void setStereo(Stereo stereo);
-        Stereo getStereo() const;
+        // pipeline of the stages picked by StagedAdvanced
+        virtual void update() = 0;
+        virtual void updateOverlay() = 0;
+
+        // raw access to PSG on the bus of the pipeline, out of
+        // the states (e.g. writes of interrupts between updates)
+        virtual void writeRegister(raddr_t addr, rdata_t data) = 0;
+        virtual void readRegister(raddr_t addr, rdata_t &data) const = 0;
 
         void setRegister(raddr_t addr, rdata_t data) override;
         void getRegister(raddr_t addr, rdata_t &data) const override;
         void setRegister(Reg reg, rdata_t data);
         void getRegister(Reg reg, rdata_t &data) const;
-        void update();
 
-    private:
+        // overlay bits of registers of the bank A (but mode/bank)
+        // on top of the input state until cleared, the input state
+        // stays untouched and comes back once they are cleared
+        void setOverlay(Reg reg, rdata_t data, rdata_t mask = 0xFF);
+        void clearOverlay(Reg reg, rdata_t mask = 0xFF);
+
+        // mode bits the PSG is in right now, the PSG is on bank A
+        // out of updates, so interrupts may write registers of bank A
+        rdata_t getChipMode() const;
+
+    protected:
+        enum { No_Field = 0xFF };
+
+        static uint8_t field_offset(Reg reg);
         void set_register(state_t& state, Reg reg, rdata_t data);
         void get_register(const state_t& state, Reg reg, rdata_t &data) const;
 
-        void process_clock_conversion();
-        void process_channels_remapping();
-        void process_compatible_mode_fix();
+        uint32_t pending_changes(bool overlay) const;
+        void latch_changes(uint32_t mask);
+        void process_overlay();
+        rdata_t output_register(raddr_t addr, raddr_t src) const;
 
-        void check_output_changes();
-        void write_output_to_chip();
+        // clock conversion of periods
+        class conversion_t
+        {
+        public:
+            conversion_t();
+            void reset_conversion(const AdvancedBase& psg);
+            bool set_ratio(const AdvancedBase& psg);
+            uint32_t latch_mask(const AdvancedBase& psg, uint32_t mask) const;
+            void convert(AdvancedBase& psg);
 
-    private:
+        private:
+            uint32_t m_ratio;
+        #ifdef ENABLE_CONVERSION_CARRY
+            uint16_t m_cerror[7];
+        #endif
+        };
+
+        struct no_conversion_t
+        {
+            void reset_conversion(const AdvancedBase&) {}
+            bool set_ratio(const AdvancedBase&) { return false; }
+            uint32_t latch_mask(const AdvancedBase&, uint32_t mask) const { return mask; }
+            void convert(AdvancedBase&) {}
+        };
+
+        // channels remapping by stereo mode, the only stage
+        // with public interface, so stereo mode exists with it
+        class remapping_t
+        {
+        public:
+            void setStereo(Stereo stereo) { m_stereo = stereo; }
+            Stereo getStereo() const { return m_stereo; }
+
+        protected:
+            remapping_t();
+            void reset_remap();
+            void remap(AdvancedBase& psg);
+            raddr_t source_register(raddr_t addr) const { return m_rmap[addr]; }
+            rdata_t remap_mixer(rdata_t data) const;
+
+        private:
+            bool build_map(bool exp);
+
+        private:
+            raddr_t m_rmap[BankB_Lst + 1];
+            Stereo  m_stereo;
+            Stereo  m_rstereo;
+            bool    m_rexp;
+        };
+
+        class no_remapping_t
+        {
+        protected:
+            void reset_remap() {}
+            void remap(AdvancedBase&) {}
+            raddr_t source_register(raddr_t addr) const { return addr; }
+            rdata_t remap_mixer(rdata_t data) const { return data; }
+        };
+
+        // fix of pure envelopes on AY8930
+        class mode_fix_t
+        {
+        public:
+            mode_fix_t() : m_fixed(0) {}
+            void reset_fix() { m_fixed = 0; }
+            void fix(AdvancedBase& psg);
+            rdata_t fix_register(raddr_t src, rdata_t data) const;
+            rdata_t fix_mixer(rdata_t data) const { return rdata_t(data & ~m_fixed); }
+
+        private:
+            uint8_t m_fixed;
+        };
+
+        struct no_mode_fix_t
+        {
+            void reset_fix() {}
+            void fix(AdvancedBase&) {}
+            rdata_t fix_register(raddr_t, rdata_t data) const { return data; }
+            rdata_t fix_mixer(rdata_t data) const { return data; }
+        };
+
+        template<bool On, class Stage, class NoStage>
+        struct select_t { using type = Stage; };
+
+        template<class Stage, class NoStage>
+        struct select_t<false, Stage, NoStage> { using type = NoStage; };
+
+    protected:
         uint32_t m_clock;
-        Stereo   m_sstereo;
-        Stereo   m_dstereo;
         state_t  m_input;
         state_t  m_output;
+        rdata_t  m_overlay[Mode_Bank];
+        rdata_t  m_omask[Mode_Bank];
+        uint32_t m_ochanged;
+        uint32_t m_reload;
+        volatile rdata_t m_mode;
+    };
+
+    // Advanced pipeline made of the given list of stages, stages off
+    // the list are empty policies, so they take neither state nor code
+    // nor cycles, e.g. StagedAdvanced<0> for a raw chip of effects;
+    // setStereo() comes with the remapping stage only. The bus is the
+    // virtual driver unless the driver type is given, then its bus
+    // operations are bound to this instance at compile time
+    template<uint8_t Stages, class Bus = Driver>
+    class StagedAdvanced : public AdvancedBase
+        , private AdvancedBase::select_t<(Stages & Clock_Conversion) != 0,
+            AdvancedBase::conversion_t, AdvancedBase::no_conversion_t>::type
+        , public AdvancedBase::select_t<(Stages & Channels_Remapping) != 0,
+            AdvancedBase::remapping_t, AdvancedBase::no_remapping_t>::type
+        , private AdvancedBase::select_t<(Stages & Compatible_Mode_Fix) != 0,
+            AdvancedBase::mode_fix_t, AdvancedBase::no_mode_fix_t>::type
+    {
+        static_assert((Stages & ~All_Stages) == 0, "unknown pipeline stage");
+
+    public:
+        StagedAdvanced(Bus& driver);
+        void reset() override;
+        void setClock(Clock clock) override;
+        void update() override;
+
+        // update PSG with changes of the overlay unless the input
+        // has changes pending, the next update() takes them along
+        void updateOverlay() override;
+
+        void writeRegister(raddr_t addr, rdata_t data) final;
+        void readRegister(raddr_t addr, rdata_t &data) const final;
+
+    private:
+        bool latch_input(bool overlay);
+        void process_output();
+        rdata_t output_register(raddr_t addr, raddr_t src) const;
+        void write_mode_bank(rdata_t data);
+        void write_output_to_chip();
+
+    private:
+        Bus& m_bus;
     };
+
+    template<uint8_t Stages, class Bus>
+    inline void StagedAdvanced<Stages, Bus>::writeRegister(raddr_t addr, rdata_t data)
+    {
+        // the access is atomic, so interrupts may write between
+        ATOMIC_SECTION
+        {
+            m_bus.chip_address(addr);
+            m_bus.chip_write(data);
+        }
+    }
+
+    template<uint8_t Stages, class Bus>
+    inline void StagedAdvanced<Stages, Bus>::readRegister(raddr_t addr, rdata_t &data) const
+    {
+        ATOMIC_SECTION
+        {
+            m_bus.chip_address(addr);
+            m_bus.chip_read(data);
+        }
+    }
+
+    // all the stages of the pipeline
+    using Advanced = StagedAdvanced<All_Stages>;
 }
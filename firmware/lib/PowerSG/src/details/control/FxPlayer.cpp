@@ -0,0 +1,125 @@
+#include "FxPlayer.h"
+#include "details/Progmem.h"
+
+namespace PowerSG
+{
+    enum // flags of the effect frame
+    {
+        Fx_Volume  = 0x0F, // volume of the channel
+        Fx_NoTone  = 0x10, // tone is disabled
+        Fx_Tone    = 0x20, // new tone period follows (2 bytes LE)
+        Fx_Noise   = 0x40, // new noise period follows, 0x20 and up ends the effect
+        Fx_NoNoise = 0x80, // noise is disabled
+        Fx_End     = 0x20, // noise period that ends the effect
+    };
+
+    FxPlayer::FxPlayer(AdvancedBase& psg)
+        : m_psg(psg)
+        , m_bank(nullptr)
+        , m_voices()
+    {}
+
+    void FxPlayer::setBank(const uint8_t* bank)
+    {
+        stop();
+        m_bank = bank;
+    }
+
+    uint8_t FxPlayer::count() const
+    {
+        return (m_bank ? pgm_read_byte(m_bank) : 0);
+    }
+
+    uint8_t FxPlayer::play(uint8_t effect, uint8_t channel)
+    {
+        if (effect >= count()) return Fx_Auto;
+        if (channel == Fx_Auto)
+        {
+            // free channel or the one playing the longest
+            channel = 0;
+            for (uint8_t i = 0; i < 3; ++i)
+            {
+                if (!m_voices[i].ptr) { channel = i; break; }
+                if (m_voices[i].age > m_voices[channel].age) channel = i;
+            }
+        }
+        else if (channel > 2) return Fx_Auto;
+
+        // offset is relative to its high byte
+        const uint8_t* entry = (m_bank + 1 + 2 * effect);
+        uint16_t offset = uint16_t(pgm_read_byte(entry) | pgm_read_byte(entry + 1) << 8);
+
+        voice_t& voice = m_voices[channel];
+        voice.ptr   = (entry + 1 + offset);
+        voice.tone  = 0;
+        voice.noise = 0;
+        voice.age   = 0;
+        return channel;
+    }
+
+    void FxPlayer::stop(uint8_t channel)
+    {
+        for (uint8_t i = 0; i < 3; ++i)
+        {
+            if ((channel == Fx_Auto || channel == i) && m_voices[i].ptr) release(i);
+        }
+    }
+
+    bool FxPlayer::playing(uint8_t channel) const
+    {
+        return (channel < 3 && m_voices[channel].ptr);
+    }
+
+    void FxPlayer::tick()
+    {
+        bool noise = false;
+        for (uint8_t i = 0; i < 3; ++i)
+        {
+            voice_t& voice = m_voices[i];
+            if (!voice.ptr) continue;
+
+            uint8_t flags = pgm_read_byte(voice.ptr++);
+            if (flags & Fx_Tone)
+            {
+                voice.tone = uint16_t(pgm_read_byte(voice.ptr) | pgm_read_byte(voice.ptr + 1) << 8);
+                voice.ptr += 2;
+            }
+            if (flags & Fx_Noise)
+            {
+                uint8_t period = pgm_read_byte(voice.ptr++);
+                if (period >= Fx_End)
+                {
+                    release(i);
+                    continue;
+                }
+                voice.noise = period;
+            }
+            voice.age++;
+
+            // tone and noise enable bits of the channel in mixer
+            rdata_t mixer = ((flags & Fx_NoTone ? 0x01 : 0x00) | (flags & Fx_NoNoise ? 0x08 : 0x00)) << i;
+            m_psg.setOverlay(Reg(raddr_t(Reg::A_Fine) + 2 * i), rdata_t(voice.tone));
+            m_psg.setOverlay(Reg(raddr_t(Reg::A_Coarse) + 2 * i), rdata_t(voice.tone >> 8) & 0x0F);
+            m_psg.setOverlay(Reg(raddr_t(Reg::A_Volume) + i), flags & Fx_Volume);
+            m_psg.setOverlay(Reg::Mixer, mixer, 0x09 << i);
+            if (!(flags & Fx_NoNoise))
+            {
+                m_psg.setOverlay(Reg::N_Period, voice.noise);
+                noise = true;
+            }
+        }
+
+        // noise period is shared, music gets it back
+        // when no effect plays the noise
+        if (!noise) m_psg.clearOverlay(Reg::N_Period);
+    }
+
+    void FxPlayer::release(uint8_t channel)
+    {
+        m_voices[channel].ptr = nullptr;
+        m_psg.clearOverlay(Reg(raddr_t(Reg::A_Fine) + 2 * channel));
+        m_psg.clearOverlay(Reg(raddr_t(Reg::A_Coarse) + 2 * channel));
+        m_psg.clearOverlay(Reg(raddr_t(Reg::A_Volume) + channel));
+        m_psg.clearOverlay(Reg::Mixer, 0x09 << channel);
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Advanced.h"
+
+namespace PowerSG
+{
+    enum
+    {
+        Fx_Auto = 0xFF, // channel chosen by the player, or all channels
+    };
+
+    // Player of AYFX sound effects from the bank in program memory
+    // (the .afb file as is: number of effects and table of offsets).
+    // Effect on a channel overlays its tone period, volume, mixer
+    // bits and noise period on top of the music in Advanced, so the
+    // music comes back as soon as the effect is over.
+    class FxPlayer
+    {
+        struct voice_t
+        {
+            const uint8_t* ptr;
+            uint16_t tone;
+            uint8_t  noise;
+            uint16_t age;
+        };
+
+    public:
+        FxPlayer(AdvancedBase& psg);
+
+        // set the bank of effects (in program memory)
+        void setBank(const uint8_t* bank);
+        uint8_t count() const;
+
+        // start the effect on the channel or on the free one (or
+        // the one playing the longest), returns the channel used
+        // or Fx_Auto if there is no such effect in the bank
+        uint8_t play(uint8_t effect, uint8_t channel = Fx_Auto);
+
+        // stop the effect of the channel, or all of them
+        void stop(uint8_t channel = Fx_Auto);
+        bool playing(uint8_t channel) const;
+
+        // play the next frame of effects, called once per period
+        // before PSG is updated
+        void tick();
+
+    private:
+        void release(uint8_t channel);
+
+    private:
+        AdvancedBase&  m_psg;
+        const uint8_t* m_bank;
+        voice_t        m_voices[3];
+    };
+}
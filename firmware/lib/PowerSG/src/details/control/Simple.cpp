@@ -4,12 +4,16 @@ namespace PowerSG
 {
     Simple::Simple(Driver &driver)
         : m_driver(driver)
+        , m_chipid(0)
     {}
 
     void Simple::begin()
     {
+        // the type of PSG is detected before use, the
+        // detection writes registers and resets PSG only
         m_driver.chip_power_on();
         setDefaultClock();
+        getChipId();
         reset();
     }
 
@@ -53,7 +57,7 @@ namespace PowerSG
             cless.test_wr_rd_latch(0x10);
             cless.test_wr_rd_exp_mode(0xA0);
             cless.test_wr_rd_exp_mode(0xB0);
-            cless.reset();
+            cless.Simple::reset();
         }
         return ChipId(m_chipid);
     }
@@ -65,18 +69,11 @@ namespace PowerSG
         setRegister(0x0A, 0x00);
     }
 
-    void Simple::setRegister(raddr_t addr, rdata_t data)
+    void Simple::flush()
     {
-        // this behavior can be overridden
-        m_driver.chip_address(addr);
-        m_driver.chip_write(data);
-    }
-
-    void Simple::getRegister(raddr_t addr, rdata_t &data) const
-    {
-        // this behavior can be overridden
-        m_driver.chip_address(addr);
-        m_driver.chip_read(data);
+        // complete the batch of writes for
+        // drivers that buffer bus operations
+        m_driver.chip_flush();
     }
 
     void Simple::update_chipid(rdata_t data)
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "drivers/Driver.h"
+#include "details/Atomic.h"
 
 namespace PowerSG
 {
@@ -36,6 +37,7 @@ namespace PowerSG
         void mute();
         virtual void setRegister(raddr_t addr, rdata_t data);
         virtual void getRegister(raddr_t addr, rdata_t &data) const;
+        void flush();
 
     private:
         // tests to detect the type of PSG
@@ -45,7 +47,28 @@ namespace PowerSG
         void test_wr_rd_exp_mode(rdata_t mode_bank);
 
     private:
-        Driver&  m_driver;
+        Driver& m_driver;
         uint32_t m_chipid;
     };
+
+    inline void Simple::setRegister(raddr_t addr, rdata_t data)
+    {
+        // this behavior can be overridden, the access is atomic
+        // so the stream interrupt may write between the writes
+        ATOMIC_SECTION
+        {
+            m_driver.chip_address(addr);
+            m_driver.chip_write(data);
+        }
+    }
+
+    inline void Simple::getRegister(raddr_t addr, rdata_t &data) const
+    {
+        // this behavior can be overridden
+        ATOMIC_SECTION
+        {
+            m_driver.chip_address(addr);
+            m_driver.chip_read(data);
+        }
+    }
 }
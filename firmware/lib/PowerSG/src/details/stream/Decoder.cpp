@@ -0,0 +1,960 @@
+#include "Decoder.h"
+#include "details/Atomic.h"
+#include "details/Progmem.h"
+
+namespace PowerSG
+{
+    // number of arguments of the commands starting from Cmd_Fst
+    const uint8_t cmd_args[] PROGMEM = 
+    {
+        1, // Fx
+        5, // Effect
+        6, // Digi
+        3, // Sample
+        4, // Timed
+        0, // Errors
+        1, // Packet
+        1, // Pack
+        1, // Instant
+        1, // Credit
+        1, // Sync
+        4, // Period
+        1, // Baud
+        0, // Info
+        2, // Frame16
+        4, // Frame32
+        1, // Read
+        2, // Write
+        0, // Reset
+        4, // Clock
+        1, // Mode
+    };
+
+    enum // states of packed frame decoding
+    {
+        Unpack_Header,
+        Unpack_Mask,
+        Unpack_Value,
+        Unpack_Literal,
+    };
+
+    Decoder::Decoder(AdvancedBase& psg)
+        : m_psg(psg)
+        , m_mode(Mode::Advanced)
+        , m_reg(0xFF)
+        , m_cmd(0x00)
+        , m_cnt(0x00)
+        , m_stp(0x00)
+        , m_mask(0x00)
+        , m_pos(0x00)
+        , m_period(tPeriod)
+        , m_target(0x00)
+        , m_trim(0)
+        , m_credit(false)
+        , m_freed(0x00)
+        , m_commit(false)
+        , m_pack(false)
+    #ifdef ENABLE_PACKED_TRANSPORT
+        , m_unpack(Unpack_Header)
+    #endif
+        , m_plen(0x00)
+        , m_pcrc(0x00)
+        , m_pbad(false)
+        , m_held(false)
+        , m_defer(false)
+        , m_checked(false)
+        , m_staged(0x00)
+        , m_errors(0x00)
+        , m_overruns(0x00)
+        , m_thead(0x00)
+        , m_ttail(0x00)
+        , m_seq(0x00)
+        , m_spos(0x00)
+        , m_slen(0x00)
+        , m_control(false)
+        , m_hhead(0x00)
+        , m_htail(0x00)
+        , m_holding(false)
+    {
+        reset_queue();
+    }
+
+    void Decoder::reset()
+    {
+        m_mode = Mode::Advanced;
+        m_reg  = 0xFF;
+        m_cmd  = 0x00;
+        m_stp  = 0x00;
+        m_mask = 0x00;
+        m_credit = false;
+        m_commit = false;
+        m_pack = false;
+        m_plen = 0x00;
+        m_held = false;
+        m_defer = false;
+        m_checked = false;
+        m_staged = 0x00;
+        m_errors = 0x00;
+        m_overruns = 0x00;
+        m_slen = 0x00;
+        m_control = false;
+        m_hhead = m_htail;
+        m_holding = false;
+        reset_queue();
+    }
+
+    bool Decoder::decode(uint8_t data)
+    {
+        if (m_holding)
+        {
+            // the main loop runs the command, the bytes that follow
+            // wait for it, credits of the host keep them in the buffer
+            if (uint8_t(m_htail - m_hhead) < Hold_Size)
+            {
+                m_hold[m_htail++ & (Hold_Size - 1)] = data;
+            }
+            else
+            {
+                m_overruns++;
+            }
+            return false;
+        }
+        return receive(data);
+    }
+
+    bool Decoder::receive(uint8_t data)
+    {
+        if (m_credit) m_freed++;
+
+        // bytes of the packet after its length
+        if (m_plen) return packet(data);
+
+        // in checked mode skip bytes up to the next header
+        if (m_checked && !m_cmd && data != uint8_t(Cmd::Packet)) return false;
+
+        return parse(data);
+    }
+
+    bool Decoder::parse(uint8_t data)
+    {
+        if (m_defer)
+        {
+            // command of the packet must be its only content,
+            // data of Sample command is staged along with it
+            if (m_cmd == uint8_t(Cmd::Sample) && m_staged < m_arg[2])
+            {
+                m_stage[m_staged++] = data;
+            }
+            else
+            {
+                m_pbad = true;
+            }
+        }
+        else if (m_slen)
+        {
+            // handle data of Sample command
+            on_sample(m_spos++, data);
+            m_slen--;
+        }
+    #ifdef ENABLE_PACKED_TRANSPORT
+        else if (m_pack)
+        {
+            // two nibbles of packed stream, the low one first
+            bool commit = unpack(data & 0x0F);
+            if (m_pack && unpack(data >> 4)) commit = true;
+            return commit;
+        }
+    #endif
+        else if (m_mask)
+        {
+            // handle value of bitmask frame
+            write_masked(m_pos, data);
+            m_mask >>= 1; m_pos++;
+            if (!m_mask) return commit_frame();
+            next_masked();
+        }
+        else if (m_cmd)
+        {
+            // handle argument of command
+            m_arg[m_cnt++] = data;
+            if (m_cnt == pgm_read_byte(cmd_args + m_cmd - Cmd_Fst))
+            {
+                return execute_command();
+            }
+        }
+        else if (m_reg <= Reg_Lst)
+        {
+            // handle data for register
+            write_register(m_reg, data);
+            m_reg = 0xFF;
+        }
+        else
+        {
+            // waiting for register number
+            if (data == uint8_t(Cmd::Frame))
+            {
+                // handle frame begining
+                return commit_frame();
+            }
+            else if (data >= Cmd_Fst)
+            {
+                // payload of the packet is one frame or command
+                if (m_plen && (m_staged || m_held || data == uint8_t(Cmd::Packet)))
+                {
+                    m_pbad = true;
+                    return false;
+                }
+
+                // handle command start
+                m_cmd = data;
+                m_cnt = 0x00;
+                if (!pgm_read_byte(cmd_args + m_cmd - Cmd_Fst))
+                {
+                    return execute_command();
+                }
+            }
+            else if (data >= Char_Fst && data <= Char_Lst)
+            {
+                // handle new char for input string
+                if (m_plen) m_pbad = true;
+                else if (m_stp < sizeof(m_str) - 2)
+                {
+                    m_str[m_stp++] = char(data);
+                }
+            }
+            else if (data <= Reg_Lst)
+            {
+                if (m_stp)
+                {
+                    // handle input string processing
+                    m_str[m_stp] = 0;
+                    on_input_string(m_str);
+                }
+                else
+                {
+                    // handle register number
+                    m_reg = data;
+                }
+                m_stp = 0x00;
+            }
+        }
+        return false;
+    }
+
+    bool Decoder::packet(uint8_t data)
+    {
+        if (--m_plen > 1)
+        {
+            // payload goes through the parser, writes are staged
+            m_pcrc = crc16(m_pcrc, data);
+            parse(data);
+            return false;
+        }
+        else if (m_plen)
+        {
+            // the low byte of CRC
+            m_pcrc ^= data;
+            return false;
+        }
+
+        // the payload must end on a frame or a command
+        bool valid = (data == (m_pcrc >> 8) && !(m_pcrc & 0xFF) && !m_pbad
+                   && m_reg > Reg_Lst && (!m_cmd || m_defer) && !m_mask
+                   && (m_cmd != uint8_t(Cmd::Sample) || m_staged == m_arg[2]));
+        bool empty = (!m_staged && !m_held && !m_defer);
+        bool defer = m_defer;
+        bool held  = m_held;
+        uint8_t staged = m_staged;
+        m_reg    = 0xFF;
+        m_mask   = 0x00;
+        m_stp    = 0x00;
+        m_staged = 0x00;
+        m_held   = false;
+        m_defer  = false;
+        if (!valid)
+        {
+            m_cmd = 0x00;
+            m_errors++;
+            return false;
+        }
+
+        if (defer)
+        {
+            // execute the command of the packet
+            m_staged = (m_cmd == uint8_t(Cmd::Sample) ? staged : 0x00);
+            bool commit = execute_command();
+            m_staged = 0x00;
+            return commit;
+        }
+        else if (empty)
+        {
+            // empty packet returns to the plain stream
+            m_checked = false;
+            return false;
+        }
+
+        // apply the frame, bit 7 of address marks masked writes
+        for (uint8_t i = 0; i < staged; i += 2)
+        {
+            raddr_t addr = m_stage[i];
+            if (addr & 0x80) write_masked(addr & 0x7F, m_stage[i + 1]);
+            else write_register(addr, m_stage[i + 1]);
+        }
+        return (held && commit_frame());
+    }
+
+    bool Decoder::stage(raddr_t addr, rdata_t data)
+    {
+        // writes of the packet wait for its CRC
+        if (!m_plen) return false;
+        if (!m_held && m_staged < sizeof(m_stage))
+        {
+            m_stage[m_staged++] = addr;
+            m_stage[m_staged++] = data;
+        }
+        else
+        {
+            m_pbad = true;
+        }
+        return true;
+    }
+
+    uint16_t Decoder::errors() const
+    {
+        return m_errors;
+    }
+
+    void Decoder::overrun()
+    {
+        m_overruns++;
+    }
+
+    uint16_t Decoder::overruns() const
+    {
+        uint16_t overruns;
+        ATOMIC_SECTION
+        {
+            overruns = m_overruns;
+        }
+        return overruns;
+    }
+
+    bool Decoder::commit()
+    {
+        if (m_holding) release_held();
+
+        // frames that arrive before the update are merged
+        if (!m_commit) return false;
+        m_commit = false;
+        if (m_mode == Mode::Advanced) m_psg.update();
+
+        // timed writes of the committed frames start now,
+        // the frame being received has the current number
+        release_timed(m_seq, false);
+        return true;
+    }
+
+    bool Decoder::tick()
+    {
+        if (m_mode != Mode::Queued) return false;
+
+        // after underrun wait until the queue is refilled
+        uint8_t fill = uint8_t(m_tail - m_head);
+        if (!fill) m_wait = Queue_Prefill;
+
+        if (m_target) sync_queue(fill);
+
+        bool play = (fill && fill >= m_wait);
+        if (play)
+        {
+            const frame_t& frame = m_queue[m_head & (Queue_Size - 1)];
+            for (raddr_t addr = BankA_Fst; addr <= BankB_Lst; ++addr)
+            {
+                if (frame.changed & (UINT32_C(1) << addr))
+                {
+                    m_psg.setRegister(Reg(addr), frame.regs[addr]);
+                }
+            }
+            release_timed(m_head, true);
+            m_head++;
+            m_wait = 0;
+        }
+        m_psg.update();
+        return play;
+    }
+
+    bool Decoder::holding() const
+    {
+        return m_holding;
+    }
+
+    void Decoder::release_held()
+    {
+        // run the command and decode the bytes held meanwhile, the
+        // interrupt keeps holding them until none are left, so the
+        // stream stays in order (the next command is run here too)
+        for (;;)
+        {
+            if (m_control) execute_control();
+
+            uint8_t data = 0x00;
+            bool held = false;
+            ATOMIC_SECTION
+            {
+                held = (m_hhead != m_htail);
+                if (held) data = m_hold[m_hhead++ & (Hold_Size - 1)];
+                else m_holding = false;
+            }
+            if (!held) break;
+            receive(data);
+        }
+    }
+
+    void Decoder::execute_control()
+    {
+        switch (Cmd(m_cmd))
+        {
+        case Cmd::Reset:
+            m_psg.reset();
+            break;
+
+        case Cmd::Clock:
+        {
+            uint8_t reply[5] = { m_cmd };
+            Clock clock = Clock(m_arg[0]) | Clock(m_arg[1]) << 8 | Clock(m_arg[2]) << 16 | Clock(m_arg[3]) << 24;
+            m_psg.setClock(clock);
+            clock = m_psg.Simple::getClock();
+            uint8_t* p = reply + 1;
+            put_le(p, clock, 4);
+            on_output(reply, sizeof(reply));
+            break;
+        }
+
+        case Cmd::Mode:
+            if (m_arg[0] <= uint8_t(Mode::Queued) && m_arg[0] != uint8_t(m_mode))
+            {
+                m_mode = Mode(m_arg[0]);
+                reset_queue();
+            }
+            break;
+
+        default: break;
+        }
+        m_control = false;
+        m_cmd = 0x00;
+    }
+
+    uint8_t Decoder::queued() const
+    {
+        return uint8_t(m_tail - m_head);
+    }
+
+    void Decoder::grant()
+    {
+        if (!m_credit) return;
+
+        // bytes are counted by the stream interrupt
+        uint16_t freed;
+        ATOMIC_SECTION
+        {
+            freed = m_freed;
+            m_freed = 0x00;
+        }
+
+        while (freed)
+        {
+            uint8_t reply[2] = { uint8_t(Cmd::Credit) };
+            reply[1] = uint8_t(freed > Credit_Max ? uint16_t(Credit_Max) : freed);
+            on_output(reply, sizeof(reply));
+            freed -= reply[1];
+        }
+    }
+
+    void Decoder::on_input_string(const char* str)
+    {
+        // this behavior can be overridden
+    }
+
+    void Decoder::on_output(const uint8_t* data, uint8_t size)
+    {
+        // this behavior can be overridden
+    }
+
+    void Decoder::on_info(info_t& info)
+    {
+        // this behavior can be overridden
+    }
+
+    void Decoder::on_baud(Baud baud)
+    {
+        // this behavior can be overridden
+    }
+
+    void Decoder::on_period(uint32_t period)
+    {
+        // this behavior can be overridden
+    }
+
+    void Decoder::on_timed(uint16_t offset, raddr_t addr, rdata_t data)
+    {
+        // this behavior can be overridden
+    }
+
+    void Decoder::on_sample(uint16_t pos, uint8_t data)
+    {
+        // this behavior can be overridden
+    }
+
+    void Decoder::on_digi(const digi_t& digi)
+    {
+        // this behavior can be overridden
+    }
+
+    void Decoder::on_effect(const effect_t& effect)
+    {
+        // this behavior can be overridden
+    }
+
+    void Decoder::on_fx(uint8_t effect, uint8_t channel)
+    {
+        // this behavior can be overridden
+    }
+
+    void Decoder::write_register(raddr_t addr, rdata_t data)
+    {
+        if (stage(addr, data)) return;
+
+        if (m_mode == Mode::Raw)
+        {
+            // host runs the pipeline, bypass it here
+            m_psg.writeRegister(addr, data);
+        }
+        else if (m_mode == Mode::Queued)
+        {
+            // the same bank switching as Advanced does
+            if (m_bank) addr += BankB_Fst;
+            if ((addr & 0x0F) == Mode_Bank)
+            {
+                m_bank = ((data & 0xF0) == 0xB0);
+                addr = Mode_Bank;
+            }
+            queue_register(addr, data);
+        }
+        else
+        {
+            m_psg.setRegister(addr, data);
+        }
+    }
+
+    void Decoder::write_masked(raddr_t addr, rdata_t data)
+    {
+        if (stage(addr | 0x80, data)) return;
+
+        if (m_mode == Mode::Raw)
+        {
+            // bank B is reachable via bank switching only
+            if (addr <= Reg_Lst) m_psg.writeRegister(addr, data);
+        }
+        else if (m_mode == Mode::Queued)
+        {
+            queue_register(addr, data);
+        }
+        else if (addr <= BankA_Lst || (addr >= BankB_Fst && addr <= BankB_Lst))
+        {
+            m_psg.setRegister(Reg(addr), data);
+        }
+    }
+
+    void Decoder::next_masked()
+    {
+        // skip registers that have not been changed
+        while (!(m_mask & 1))
+        {
+            m_mask >>= 1; m_pos++;
+        }
+    }
+
+#ifdef ENABLE_PACKED_TRANSPORT
+    bool Decoder::unpack(uint8_t code)
+    {
+        switch (m_unpack)
+        {
+        case Unpack_Mask:
+            // collect new mask, the low nibble first
+            m_mask |= uint32_t(code) << (4 * m_cnt);
+            if (++m_cnt < 4) return false;
+            m_model.useMask(uint16_t(m_mask));
+            return start_packed();
+
+        case Unpack_Value:
+            if (code < Pack_Literal)
+            {
+                return next_packed(m_model.getValue(m_pos, code));
+            }
+            m_unpack = Unpack_Literal;
+            m_arg[0] = 0x00;
+            m_cnt = 0x00;
+            return false;
+
+        case Unpack_Literal:
+            m_arg[0] |= code << (4 * m_cnt);
+            if (++m_cnt < 2) return false;
+            return next_packed(m_arg[0]);
+
+        default:
+            if (code < Pack_Masks)
+            {
+                m_mask = m_model.getMask(code);
+                m_model.useMask(uint16_t(m_mask));
+                return start_packed();
+            }
+            else if (code == Pack_Empty)
+            {
+                return commit_frame();
+            }
+            else if (code == Pack_Mask)
+            {
+                m_unpack = Unpack_Mask;
+                m_mask = 0x00;
+                m_cnt = 0x00;
+            }
+            else if (code == Pack_Exit)
+            {
+                m_pack = false;
+            }
+            return false;
+        }
+    }
+
+    bool Decoder::start_packed()
+    {
+        // packed frames carry registers of bank A only
+        m_mask &= (UINT32_C(1) << (BankA_Lst + 1)) - 1;
+        m_unpack = Unpack_Header;
+        if (!m_mask) return commit_frame();
+        m_unpack = Unpack_Value;
+        m_pos = 0x00;
+        next_masked();
+        return false;
+    }
+
+    bool Decoder::next_packed(rdata_t data)
+    {
+        write_masked(m_pos, data);
+        m_model.useValue(m_pos, data);
+        m_mask >>= 1; m_pos++;
+        if (!m_mask)
+        {
+            m_unpack = Unpack_Header;
+            return commit_frame();
+        }
+        m_unpack = Unpack_Value;
+        next_masked();
+        return false;
+    }
+#endif
+
+    void Decoder::queue_register(raddr_t addr, rdata_t data)
+    {
+        // the frame being received is in the slot at tail
+        if (addr <= BankA_Lst || (addr >= BankB_Fst && addr <= BankB_Lst))
+        {
+            frame_t& frame = m_queue[m_tail & (Queue_Size - 1)];
+            frame.regs[addr] = data;
+            frame.changed |= (UINT32_C(1) << addr);
+        }
+    }
+
+    void Decoder::release_timed(uint8_t seq, bool played)
+    {
+        // writes are in order of frames, release those of the played
+        // frame or all but those of the frame being received
+        while (m_thead != m_ttail)
+        {
+            const timed_t& timed = m_timed[m_thead & (Timed_Size - 1)];
+            if ((timed.seq == seq) != played) break;
+            on_timed(timed.offset, timed.addr, timed.data);
+            m_thead++;
+        }
+    }
+
+    void Decoder::reset_queue()
+    {
+        m_head = 0x00;
+        m_tail = 0x00;
+        m_wait = Queue_Prefill;
+        m_bank = false;
+        m_queue[0].changed = 0;
+        m_thead = m_ttail;
+        reset_sync();
+    }
+
+    void Decoder::reset_sync()
+    {
+        m_ticks = 0x00;
+        m_level = int16_t(m_target << 8);
+        if (m_trim)
+        {
+            m_trim = 0;
+            on_period(m_period);
+        }
+    }
+
+    void Decoder::sync_queue(uint8_t fill)
+    {
+        // smooth the fill level (8.8 fixed point) and trim
+        // the period by ~0.5% per frame of level deviation
+        // (up to 1%), the queue settles near target level
+        m_level += ((int16_t(fill) << 8) - m_level) >> 4;
+        if (++m_ticks < Sync_Interval) return;
+        m_ticks = 0x00;
+
+        int16_t error = (m_level - int16_t(m_target << 8));
+        int16_t trim  = error + error / 4;
+        if (trim >  Trim_Max) trim =  Trim_Max;
+        if (trim < -Trim_Max) trim = -Trim_Max;
+        if (trim != m_trim)
+        {
+            m_trim = trim;
+            on_period(m_period - ((int32_t(m_period >> 4) * m_trim) >> 12));
+        }
+
+        uint8_t report[4] = { uint8_t(Cmd::Sync), fill };
+        report[2] = uint8_t(m_trim);
+        report[3] = uint8_t(m_trim >> 8);
+        on_output(report, sizeof(report));
+    }
+
+    bool Decoder::execute_command()
+    {
+        if (m_plen && m_cmd != uint8_t(Cmd::Frame16) && m_cmd != uint8_t(Cmd::Frame32))
+        {
+            // command of the packet waits for its CRC
+            m_defer = true;
+            return false;
+        }
+
+        uint8_t reply[1 + Info_Size] = { m_cmd };
+        switch (Cmd(m_cmd))
+        {
+        case Cmd::Period:
+        {
+            uint32_t period = uint32_t(m_arg[0]) | uint32_t(m_arg[1]) << 8 | uint32_t(m_arg[2]) << 16 | uint32_t(m_arg[3]) << 24;
+            if (period)
+            {
+                m_period = period;
+                m_trim = 0;
+                on_period(period);
+            }
+            break;
+        }
+
+        case Cmd::Fx:
+        {
+            uint8_t channel = (m_arg[0] >> 6);
+            on_fx(m_arg[0] & Fx_Stop, channel ? channel - 1 : Fx_Auto);
+            break;
+        }
+
+        case Cmd::Effect:
+            if (m_arg[0] <= uint8_t(Effect::Buzzer) && m_arg[1] < 3)
+            {
+                effect_t effect;
+                effect.kind    = Effect(m_arg[0]);
+                effect.channel = m_arg[1];
+                effect.period  = uint16_t(m_arg[2] | m_arg[3] << 8);
+                effect.data    = m_arg[4];
+                on_effect(effect);
+            }
+            break;
+
+        case Cmd::Digi:
+        {
+            digi_t digi;
+            digi.channel = (m_arg[0] & ~Digi_Loop);
+            digi.loop    = (m_arg[0] & Digi_Loop) != 0;
+            digi.period  = m_arg[1];
+            digi.start   = uint16_t(m_arg[2] | m_arg[3] << 8);
+            digi.length  = uint16_t(m_arg[4] | m_arg[5] << 8);
+            if (digi.channel > Digi_Stop) digi.channel = Digi_Stop;
+            on_digi(digi);
+            break;
+        }
+
+        case Cmd::Sample:
+            // data follows the arguments, in the packet it has been staged
+            m_spos = uint16_t(m_arg[0] | m_arg[1] << 8);
+            for (uint8_t i = 0; i < m_staged; ++i) on_sample(m_spos++, m_stage[i]);
+            m_slen = m_arg[2] - m_staged;
+            break;
+
+        case Cmd::Timed:
+            // the write waits for the frame being received
+            if (uint8_t(m_ttail - m_thead) < Timed_Size)
+            {
+                timed_t& timed = m_timed[m_ttail & (Timed_Size - 1)];
+                timed.offset = uint16_t(m_arg[0] | m_arg[1] << 8);
+                timed.addr = m_arg[2];
+                timed.data = m_arg[3];
+                timed.seq  = (m_mode == Mode::Queued ? m_tail : m_seq);
+                m_ttail++;
+            }
+            break;
+
+        case Cmd::Errors:
+        {
+            uint8_t* p = reply + 1;
+            put_le(p, m_errors, 2);
+            put_le(p, overruns(), 2);
+            on_output(reply, 5);
+            break;
+        }
+
+        case Cmd::Packet:
+            // payload and CRC are left, the CRC covers the header
+            m_checked = true;
+            if (m_arg[0] <= Packet_Max)
+            {
+                m_plen = m_arg[0] + 2;
+                m_pcrc = crc16(crc16(0x0000, m_cmd), m_arg[0]);
+                m_pbad = false;
+            }
+            else
+            {
+                m_errors++;
+            }
+            break;
+
+        case Cmd::Pack:
+        #ifdef ENABLE_PACKED_TRANSPORT
+            m_pack = (m_arg[0] != 0);
+            m_unpack = Unpack_Header;
+            m_model.reset();
+        #endif
+            break;
+
+        case Cmd::Credit:
+        {
+            // the host waits for the first grant, so the
+            // buffer is empty except for this command
+            uint16_t buffer = get_info().buffer;
+            m_credit = (m_arg[0] && buffer > 1);
+            m_freed = (m_credit ? buffer - 1 : 0);
+            grant();
+            break;
+        }
+
+        case Cmd::Sync:
+            if (m_arg[0] >= Queue_Size) m_arg[0] = Queue_Size - 1;
+            m_target = m_arg[0];
+            reset_sync();
+            break;
+
+        case Cmd::Baud:
+        {
+            info_t info = get_info();
+            bool supported = (m_arg[0] < 8 && (info.bauds & (1 << m_arg[0])));
+            reply[1] = (supported ? m_arg[0] : 0xFF);
+            on_output(reply, 2);
+            if (supported) on_baud(Baud(m_arg[0]));
+            break;
+        }
+
+        case Cmd::Info:
+        {
+            info_t info = get_info();
+            uint8_t* p = reply + 1;
+            put_le(p, info.version, 2);
+            put_le(p, info.chipid, 4);
+            put_le(p, info.clock, 4);
+            put_le(p, info.buffer, 2);
+            put_le(p, info.bauds, 1);
+            put_le(p, info.features, 1);
+            on_output(reply, sizeof(reply));
+            break;
+        }
+
+        case Cmd::Frame16:
+        case Cmd::Frame32:
+            m_cmd = 0x00;
+            m_mask = 0x00;
+            while (m_cnt) m_mask = (m_mask << 8 | m_arg[--m_cnt]);
+            if (!m_mask) return commit_frame();
+            m_pos = 0x00;
+            next_masked();
+            return false;
+
+        case Cmd::Read:
+            m_psg.readRegister(m_arg[0], reply[1]);
+            on_output(reply, 2);
+            break;
+
+        case Cmd::Write:
+            m_psg.writeRegister(m_arg[0], m_arg[1]);
+            break;
+
+        case Cmd::Reset:
+        case Cmd::Clock:
+        case Cmd::Mode:
+            // they change PSG and the queue of frames the main loop
+            // works with, so it runs them and the stream waits for it
+            m_control = true;
+            m_holding = true;
+            return false;
+
+        default: break;
+        }
+        m_cmd = 0x00;
+        return false;
+    }
+
+    info_t Decoder::get_info()
+    {
+        info_t info {};
+        info.buffer = Hold_Size;
+    #ifdef ENABLE_PACKED_TRANSPORT
+        info.features = Feature_Pack;
+    #endif
+        info.chipid = uint32_t(m_psg.getChipId());
+        info.clock  = m_psg.Simple::getClock();
+        on_info(info);
+        return info;
+    }
+
+    void Decoder::put_le(uint8_t*& ptr, uint32_t data, uint8_t size)
+    {
+        while (size--)
+        {
+            *ptr++ = uint8_t(data);
+            data >>= 8;
+        }
+    }
+
+    bool Decoder::commit_frame()
+    {
+        // frame of the packet waits for its CRC
+        if (m_plen)
+        {
+            m_held = true;
+            return false;
+        }
+
+        if (m_mode != Mode::Queued)
+        {
+            // PSG is updated by the device via commit()
+            m_commit = true;
+            m_seq++;
+        }
+        else if (m_mode == Mode::Queued)
+        {
+            // publish the frame if there is room in the queue,
+            // otherwise the next one is merged into its slot
+            if (uint8_t(m_tail - m_head) < Queue_Size - 1)
+            {
+                m_queue[++m_tail & (Queue_Size - 1)].changed = 0;
+            }
+        }
+        m_stp = 0x00;
+        return true;
+    }
+}
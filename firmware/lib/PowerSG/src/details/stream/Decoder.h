@@ -0,0 +1,170 @@
+#pragma once
+
+#include "Frame.h"
+#include "Protocol.h"
+#include "PackModel.h"
+#include "details/control/Advanced.h"
+#include "details/control/FxPlayer.h"
+
+// packed transport (Pack command), its model takes 136 bytes of RAM
+#define ENABLE_PACKED_TRANSPORT
+
+namespace PowerSG
+{
+    enum
+    {
+        Queue_Size    = 8,   // frame slots of the queued mode (power of two)
+        Queue_Prefill = 4,   // frames to wait for after the queue underrun
+        Trim_Max      = 655, // max trim of playback period (1/65536, 1%)
+        Timed_Size    = 16,  // timed writes waiting for their frames (power of two)
+        Hold_Size     = 64,  // bytes held while the main loop runs a command (power of two)
+    };
+
+    class Decoder
+    {
+    public:
+        Decoder(AdvancedBase& psg);
+        void reset();
+
+        // handle the next byte of the stream, returns
+        // true if the byte has committed the frame
+        bool decode(uint8_t data);
+
+        // update PSG with the frame committed by the stream, called
+        // by the device out of the interrupt that decodes the stream,
+        // runs commands that change PSG or the queue of frames first
+        bool commit();
+
+        // a command waits for commit(), the stream is held back
+        bool holding() const;
+
+        // apply the next queued frame and update PSG, called by
+        // the playback timer of the device once per period
+        bool tick();
+        uint8_t queued() const;
+
+        // grant the host credits for the bytes decoded since
+        // the last grant, called by the device along with the
+        // commit (has no effect without flow control)
+        void grant();
+
+        // number of packets dropped as corrupted
+        uint16_t errors() const;
+
+        // count bytes lost before decoding (USART data overrun
+        // reported by the device, or the full hold buffer)
+        void overrun();
+        uint16_t overruns() const;
+
+    protected:
+        // called on each completed input string
+        virtual void on_input_string(const char* str);
+
+        // called to send the reply to the host
+        virtual void on_output(const uint8_t* data, uint8_t size);
+
+        // called to complete capabilities of the device
+        virtual void on_info(info_t& info);
+
+        // called to switch the link to the supported baud rate
+        // after the reply has been sent, or to confirm it
+        virtual void on_baud(Baud baud);
+
+        // called to change the period of playback timer (us)
+        virtual void on_period(uint32_t period);
+
+        // called when the frame of timed write has started, the
+        // write is due at the offset (us) from now
+        virtual void on_timed(uint16_t offset, raddr_t addr, rdata_t data);
+
+        // called to store a byte of samples at the position
+        // of the device memory (two 4-bit samples, low first)
+        virtual void on_sample(uint16_t pos, uint8_t data);
+
+        // called to start or stop sample playback
+        virtual void on_digi(const digi_t& digi);
+
+        // called to start, change or stop the timer effect
+        virtual void on_effect(const effect_t& effect);
+
+        // called to start the sound effect of the device bank on
+        // the channel (or Fx_Auto), Fx_Stop effect stops it
+        virtual void on_fx(uint8_t effect, uint8_t channel);
+
+    private:
+        bool receive(uint8_t data);
+        bool parse(uint8_t data);
+        bool packet(uint8_t data);
+        bool stage(raddr_t addr, rdata_t data);
+        void write_register(raddr_t addr, rdata_t data);
+        void write_masked(raddr_t addr, rdata_t data);
+        void next_masked();
+    #ifdef ENABLE_PACKED_TRANSPORT
+        bool unpack(uint8_t code);
+        bool start_packed();
+        bool next_packed(rdata_t data);
+    #endif
+        void queue_register(raddr_t addr, rdata_t data);
+        void reset_queue();
+        void release_timed(uint8_t seq, bool played);
+        void reset_sync();
+        void sync_queue(uint8_t fill);
+        bool execute_command();
+        void execute_control();
+        void release_held();
+        bool commit_frame();
+        info_t get_info();
+        static void put_le(uint8_t*& ptr, uint32_t data, uint8_t size);
+
+    private:
+        AdvancedBase& m_psg;
+        Mode      m_mode;
+        raddr_t   m_reg;
+        uint8_t   m_cmd;
+        uint8_t   m_cnt;
+        uint8_t   m_arg[6];
+        uint8_t   m_stp;
+        char      m_str[64];
+        uint32_t  m_mask;
+        raddr_t   m_pos;
+        frame_t   m_queue[Queue_Size];
+        volatile uint8_t m_head;
+        volatile uint8_t m_tail;
+        uint8_t   m_wait;
+        bool      m_bank;
+        uint32_t  m_period;
+        uint8_t   m_target;
+        uint8_t   m_ticks;
+        int16_t   m_level;
+        int16_t   m_trim;
+        bool      m_credit;
+        uint16_t  m_freed;
+        volatile bool m_commit;
+        bool      m_pack;
+    #ifdef ENABLE_PACKED_TRANSPORT
+        uint8_t   m_unpack;
+        PackModel m_model;
+    #endif
+        uint8_t   m_plen;
+        uint16_t  m_pcrc;
+        bool      m_pbad;
+        bool      m_held;
+        bool      m_defer;
+        bool      m_checked;
+        uint8_t   m_staged;
+        uint8_t   m_stage[2 * (BankB_Lst + 1)];
+        uint16_t  m_errors;
+        volatile uint16_t m_overruns;
+        timed_t   m_timed[Timed_Size];
+        volatile uint8_t m_thead;
+        volatile uint8_t m_ttail;
+        uint8_t   m_seq;
+        uint16_t  m_spos;
+        uint8_t   m_slen;
+        bool      m_control;
+        uint8_t   m_hold[Hold_Size];
+        volatile uint8_t m_hhead;
+        volatile uint8_t m_htail;
+        volatile bool m_holding;
+    };
+}
@@ -0,0 +1,228 @@
+#include "Encoder.h"
+
+namespace PowerSG
+{
+    Encoder::Encoder(uint8_t* buffer, uint16_t size)
+        : m_buf(buffer)
+        , m_cap(size)
+        , m_len(0)
+        , m_pack(false)
+        , m_half(false)
+        , m_packet(0)
+    {}
+
+    void Encoder::clear()
+    {
+        m_len = 0;
+        m_packet = 0;
+    }
+
+    const uint8_t* Encoder::data() const
+    {
+        return m_buf;
+    }
+
+    uint16_t Encoder::size() const
+    {
+        return m_len;
+    }
+
+    bool Encoder::putRegister(raddr_t addr, rdata_t data)
+    {
+        if (addr > Reg_Lst || !leave_packed() || m_len + 2 > m_cap) return false;
+        m_buf[m_len++] = addr;
+        m_buf[m_len++] = data;
+        return true;
+    }
+
+    bool Encoder::putFrame()
+    {
+        return leave_packed() && put(uint8_t(Cmd::Frame));
+    }
+
+    bool Encoder::putCommand(Cmd cmd, const uint8_t* args, uint8_t size)
+    {
+        if (!leave_packed() || m_len + 1 + size > m_cap) return false;
+        m_buf[m_len++] = uint8_t(cmd);
+        while (size--) m_buf[m_len++] = *args++;
+        return true;
+    }
+
+    bool Encoder::putTimed(uint16_t offset, raddr_t addr, rdata_t data)
+    {
+        uint8_t args[] = { uint8_t(offset), uint8_t(offset >> 8), addr, data };
+        return putCommand(Cmd::Timed, args, sizeof(args));
+    }
+
+    bool Encoder::putSample(uint16_t pos, const uint8_t* data, uint8_t size)
+    {
+        uint8_t args[] = { uint8_t(pos), uint8_t(pos >> 8), size };
+        if (!leave_packed() || m_len + 1 + sizeof(args) + size > m_cap) return false;
+        putCommand(Cmd::Sample, args, sizeof(args));
+        while (size--) m_buf[m_len++] = *data++;
+        return true;
+    }
+
+    bool Encoder::putDigi(const digi_t& digi)
+    {
+        uint8_t args[] =
+        {
+            uint8_t(digi.channel | (digi.loop ? Digi_Loop : 0)), digi.period,
+            uint8_t(digi.start), uint8_t(digi.start >> 8),
+            uint8_t(digi.length), uint8_t(digi.length >> 8)
+        };
+        return putCommand(Cmd::Digi, args, sizeof(args));
+    }
+
+    bool Encoder::putEffect(const effect_t& effect)
+    {
+        uint8_t args[] =
+        {
+            uint8_t(effect.kind), effect.channel,
+            uint8_t(effect.period), uint8_t(effect.period >> 8), effect.data
+        };
+        return putCommand(Cmd::Effect, args, sizeof(args));
+    }
+
+    bool Encoder::putFx(uint8_t effect, uint8_t channel)
+    {
+        if (effect > Fx_Stop || (channel > 2 && channel != Fx_Auto)) return false;
+        uint8_t args[] = { uint8_t(effect | (channel == Fx_Auto ? 0 : channel + 1) << 6) };
+        return putCommand(Cmd::Fx, args, sizeof(args));
+    }
+
+    bool Encoder::putFrame(const frame_t& frame)
+    {
+        for (raddr_t addr = BankA_Fst; addr <= BankA_Lst; ++addr)
+        {
+            if (frame.changed & (UINT32_C(1) << addr))
+            {
+                if (!putRegister(addr, frame.regs[addr])) return false;
+            }
+        }
+        return putFrame();
+    }
+
+    bool Encoder::putMasked(const frame_t& frame)
+    {
+        const uint32_t valid = ((UINT32_C(1) << (BankA_Lst + 1)) - (UINT32_C(1) << BankA_Fst))
+                             | ((UINT32_C(1) << (BankB_Lst + 1)) - (UINT32_C(1) << BankB_Fst));
+        uint32_t mask = (frame.changed & valid);
+        uint8_t  size = (mask >> 16 ? 4 : 2);
+
+        uint8_t args[4];
+        for (uint8_t i = 0; i < size; ++i) args[i] = uint8_t(mask >> (8 * i));
+        if (!putCommand(size == 4 ? Cmd::Frame32 : Cmd::Frame16, args, size)) return false;
+
+        for (raddr_t addr = 0; mask; ++addr, mask >>= 1)
+        {
+            if ((mask & 1) && !put(frame.regs[addr])) return false;
+        }
+        return true;
+    }
+
+    bool Encoder::putPacked(const frame_t& frame)
+    {
+        // the model must not change unless the whole frame fits:
+        // header, mask and two nibbles of literal per register
+        uint16_t worst = (m_pack ? 0 : 2) + (1 + 4 + 3 * (BankA_Lst + 1) + 1) / 2;
+        if (m_len + worst > m_cap) return false;
+
+        if (!m_pack)
+        {
+            // switch the device to packed transport
+            m_buf[m_len++] = uint8_t(Cmd::Pack);
+            m_buf[m_len++] = 1;
+            m_model.reset();
+            m_pack = true;
+        }
+
+        uint16_t mask = uint16_t(frame.changed & ((UINT32_C(1) << (BankA_Lst + 1)) - 1));
+        if (mask)
+        {
+            uint8_t index = m_model.findMask(mask);
+            if (index < Pack_Masks)
+            {
+                put_nibble(index);
+            }
+            else
+            {
+                put_nibble(Pack_Mask);
+                for (uint8_t i = 0; i < 4; ++i) put_nibble(uint8_t(mask >> (4 * i)));
+            }
+            m_model.useMask(mask);
+
+            for (raddr_t addr = 0; mask; ++addr, mask >>= 1)
+            {
+                if (!(mask & 1)) continue;
+                rdata_t data = frame.regs[addr];
+                uint8_t code = m_model.findValue(addr, data);
+                put_nibble(code);
+                if (code == Pack_Literal)
+                {
+                    put_nibble(data);
+                    put_nibble(data >> 4);
+                }
+                m_model.useValue(addr, data);
+            }
+        }
+        else
+        {
+            put_nibble(Pack_Empty);
+        }
+
+        // frame is committed by its last nibble, so it goes now
+        if (m_half) put_nibble(Pack_Pad);
+        return true;
+    }
+
+    bool Encoder::beginPacket()
+    {
+        // header and length, the length is set by endPacket()
+        if (!leave_packed() || m_len + 2 > m_cap) return false;
+        m_buf[m_len++] = uint8_t(Cmd::Packet);
+        m_buf[m_len++] = 0;
+        m_packet = m_len;
+        return true;
+    }
+
+    bool Encoder::endPacket()
+    {
+        uint16_t size = m_len - m_packet;
+        if (!m_packet || size > Packet_Max || m_len + 2 > m_cap) return false;
+        m_buf[m_packet - 1] = uint8_t(size);
+
+        uint16_t crc = 0x0000;
+        for (uint16_t i = m_packet - 2; i < m_len; ++i) crc = crc16(crc, m_buf[i]);
+        m_buf[m_len++] = uint8_t(crc);
+        m_buf[m_len++] = uint8_t(crc >> 8);
+        m_packet = 0;
+        return true;
+    }
+
+    void Encoder::put_nibble(uint8_t code)
+    {
+        // the low nibble of a byte first
+        code &= 0x0F;
+        if (m_half) m_buf[m_len - 1] |= (code << 4);
+        else m_buf[m_len++] = code;
+        m_half = !m_half;
+    }
+
+    bool Encoder::leave_packed()
+    {
+        // exit nibble in both halves, a device out of packed
+        // transport takes it as a harmless frame marker
+        if (!m_pack) return true;
+        if (!put(Pack_Exit | Pack_Exit << 4)) return false;
+        m_pack = false;
+        return true;
+    }
+
+    bool Encoder::put(uint8_t data)
+    {
+        if (m_len + 1 > m_cap) return false;
+        m_buf[m_len++] = data;
+        return true;
+    }
+}
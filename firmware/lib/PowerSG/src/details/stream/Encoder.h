@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Frame.h"
+#include "Protocol.h"
+#include "PackModel.h"
+#include "details/control/FxPlayer.h"
+
+namespace PowerSG
+{
+    class Encoder
+    {
+    public:
+        Encoder(uint8_t* buffer, uint16_t size);
+        void clear();
+
+        const uint8_t* data() const;
+        uint16_t size() const;
+
+        // put register/value pair and frame marker, returns
+        // false if there is no room left in the buffer
+        bool putRegister(raddr_t addr, rdata_t data);
+        bool putFrame();
+
+        // put command with its arguments
+        bool putCommand(Cmd cmd, const uint8_t* args = nullptr, uint8_t size = 0);
+
+        // put raw write at the offset (us) from the start of the
+        // frame it is sent with, before the end of that frame
+        bool putTimed(uint16_t offset, raddr_t addr, rdata_t data);
+
+        // put bytes of samples to the position of the device memory
+        // (two 4-bit samples per byte, the low nibble first) and
+        // start or stop their playback through the channel volume
+        bool putSample(uint16_t pos, const uint8_t* data, uint8_t size);
+        bool putDigi(const digi_t& digi);
+
+        // put descriptor of the timer effect, only when it changes
+        bool putEffect(const effect_t& effect);
+
+        // put start of the sound effect of the device bank on the
+        // channel (or Fx_Auto), Fx_Stop effect stops the channel
+        bool putFx(uint8_t effect, uint8_t channel = Fx_Auto);
+
+        // put changed registers of the bank A and frame marker
+        bool putFrame(const frame_t& frame);
+
+        // put changed registers as bitmask frame, 32-bit
+        // mask is used only if registers of bank B changed
+        bool putMasked(const frame_t& frame);
+
+        // put changed registers of the bank A as packed frame, the
+        // first one switches the device to packed transport and any
+        // other put switches it back
+        bool putPacked(const frame_t& frame);
+
+        // wrap one frame or command put between these calls into
+        // packet with CRC (packed frames can not be wrapped), empty
+        // packet returns the device to the plain stream
+        bool beginPacket();
+        bool endPacket();
+
+    private:
+        bool put(uint8_t data);
+        void put_nibble(uint8_t code);
+        bool leave_packed();
+
+    private:
+        uint8_t* m_buf;
+        uint16_t m_cap;
+        uint16_t m_len;
+        bool     m_pack;
+        bool     m_half;
+        uint16_t m_packet;
+        PackModel m_model;
+    };
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Protocol.h"
+#include "details/control/Advanced.h"
+
+namespace PowerSG
+{
+    // Register frame as it travels between producers and the stream:
+    // the register file indexed by numeric value of Reg and the mask
+    // of changed registers with the same layout as Advanced uses.
+    struct frame_t
+    {
+        rdata_t  regs[BankB_Lst + 1];
+        uint32_t changed;
+    };
+
+    // Timed write waiting for its frame: offset from the start
+    // of the frame (us) and the sequence number of the frame.
+    struct timed_t
+    {
+        uint16_t offset;
+        raddr_t  addr;
+        rdata_t  data;
+        uint8_t  seq;
+    };
+
+    // Sample playback of Digi command: channel (0-2, or Digi_Stop)
+    // with volume written at the sample period (us), start and length
+    // of the sample in the device memory (bytes) and looping.
+    struct digi_t
+    {
+        uint16_t start;
+        uint16_t length;
+        uint8_t  period;
+        uint8_t  channel;
+        bool     loop;
+    };
+
+    // Timer effect of Effect command: the channel it runs on, period
+    // of its writes (us) and the volume or the envelope shape.
+    struct effect_t
+    {
+        Effect   kind;
+        uint8_t  channel;
+        uint16_t period;
+        rdata_t  data;
+    };
+}
@@ -0,0 +1,66 @@
+#include "PackModel.h"
+#include <string.h>
+
+namespace PowerSG
+{
+    void PackModel::reset()
+    {
+        memset(m_masks, 0, sizeof(m_masks));
+        memset(m_values, 0, sizeof(m_values));
+    }
+
+    uint8_t PackModel::findMask(uint16_t mask) const
+    {
+        uint8_t index = 0;
+        while (index < Pack_Masks && m_masks[index] != mask) index++;
+        return index;
+    }
+
+    uint16_t PackModel::getMask(uint8_t index) const
+    {
+        return m_masks[index];
+    }
+
+    void PackModel::useMask(uint16_t mask)
+    {
+        // move the mask to front, the last one drops out if new
+        uint8_t index = findMask(mask);
+        if (index == Pack_Masks) index--;
+        for (; index; --index) m_masks[index] = m_masks[index - 1];
+        m_masks[0] = mask;
+    }
+
+    uint8_t PackModel::findValue(raddr_t addr, rdata_t data) const
+    {
+        const rdata_t* values = m_values[addr];
+        for (uint8_t index = 0; index < Pack_Values; ++index)
+        {
+            if (values[index] == data) return index;
+        }
+
+        int8_t delta = int8_t(data - values[0]);
+        if (delta > 0 && delta <= Pack_Delta) return Pack_Values + delta - 1;
+        if (delta < 0 && delta >= -Pack_Delta) return Pack_Values + Pack_Delta - delta - 1;
+        return Pack_Literal;
+    }
+
+    rdata_t PackModel::getValue(raddr_t addr, uint8_t code) const
+    {
+        const rdata_t* values = m_values[addr];
+        if (code < Pack_Values) return values[code];
+
+        code -= Pack_Values;
+        if (code < Pack_Delta) return values[0] + code + 1;
+        return values[0] - (code - Pack_Delta + 1);
+    }
+
+    void PackModel::useValue(raddr_t addr, rdata_t data)
+    {
+        // move the value to front, the last one drops out if new
+        rdata_t* values = m_values[addr];
+        uint8_t index = 0;
+        while (index < Pack_Values - 1 && values[index] != data) index++;
+        for (; index; --index) values[index] = values[index - 1];
+        values[0] = data;
+    }
+}
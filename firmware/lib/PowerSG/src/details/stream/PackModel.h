@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Protocol.h"
+#include "details/control/Advanced.h"
+
+namespace PowerSG
+{
+    // Model of packed transport, kept the same way by the encoder
+    // and the decoder: recently used masks of changed registers and
+    // recently used values of each register of bank A, the last one
+    // first (it is also the base of deltas).
+    class PackModel
+    {
+    public:
+        void reset();
+
+        // index of the mask or Pack_Masks if it is not known
+        uint8_t findMask(uint16_t mask) const;
+        uint16_t getMask(uint8_t index) const;
+        void useMask(uint16_t mask);
+
+        // value code of the register, Pack_Literal if the
+        // value can not be predicted from the model
+        uint8_t findValue(raddr_t addr, rdata_t data) const;
+        rdata_t getValue(raddr_t addr, uint8_t code) const;
+        void useValue(raddr_t addr, rdata_t data);
+
+    private:
+        uint16_t m_masks[Pack_Masks];
+        rdata_t  m_values[BankA_Lst + 1][Pack_Values];
+    };
+}
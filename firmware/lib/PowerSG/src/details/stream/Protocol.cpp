@@ -0,0 +1,23 @@
+#include "Protocol.h"
+
+#if defined(__AVR__)
+#include <util/crc16.h>
+#endif
+
+namespace PowerSG
+{
+    uint16_t crc16(uint16_t crc, uint8_t data)
+    {
+#if defined(__AVR__)
+        return _crc_xmodem_update(crc, data);
+#else
+        // the same as the avr-libc one, bit by bit
+        crc ^= uint16_t(data) << 8;
+        for (uint8_t i = 0; i < 8; ++i)
+        {
+            crc = (crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1);
+        }
+        return crc;
+#endif
+    }
+}
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace PowerSG
+{
+    // Byte protocol of the AYM Streamer serial link. Outside of
+    // a frame the stream is a sequence of register/value pairs
+    // (register number 0x00-0x0F followed by its value) and the
+    // frame marker that commits the received registers to PSG.
+    // Printable chars terminated by a byte 0x00-0x0F form text
+    // input strings. Bytes from Cmd_Fst to 0xFE start commands
+    // with fixed number of arguments, replies of the device start
+    // with the code of the command they answer.
+    //
+    // Bitmask frames are the compact alternative to pairs: the mask
+    // of changed registers (16 or 32 bits LE, bit number is numeric
+    // value of Reg as in Advanced) followed by the values of changed
+    // registers only, in order of bits. The last value commits the
+    // frame, so typical frame of 8 registers takes 11 bytes instead
+    // of 17. Both formats can be mixed freely in the same stream.
+    //
+    // The host may switch the link to a higher baud rate: after the
+    // reply to Baud command both sides change the rate and the host
+    // confirms it with the same Baud command at the new rate. If no
+    // confirmation comes within tConfirm, the device falls back to
+    // the previous rate (and so does the host without the reply).
+    //
+    // In queued mode frames are not applied on arrival but stored
+    // in the queue of the device, which plays exactly one frame per
+    // period of its own timer. The host can send frames in bursts,
+    // timing of playback does not depend on the link and the host.
+    // With Sync enabled the device keeps the queue filled to target
+    // level by trimming its playback period (within 1%), so the
+    // drift of host and device clocks never under- or overruns the
+    // queue, and reports the fill level every Sync_Interval frames.
+    //
+    // With credit flow control enabled the device grants the host
+    // credits for bytes it has decoded, the first grant gives the
+    // whole free buffer. The host waits for it and then never sends
+    // more bytes than it has been granted, so the bytes waiting in
+    // the buffer while the device runs a command can not overflow it.
+    // Credits can not help the USART of the device when its interrupt
+    // is late, bytes lost that way are counted with the others and
+    // reported along with dropped packets by Errors command.
+    //
+    // The device decodes bytes as they arrive, the frame goes to PSG
+    // as soon as its last byte is received. Instant command of the
+    // former immediate mode is reserved, its argument is skipped.
+    //
+    // Packed transport carries frames of bank A as nibbles (the low
+    // one of a byte first) coded against a model kept by both ends:
+    // the header nibble refers to one of recently used masks of
+    // changed registers or brings a new one, each changed register
+    // gets a nibble with index of its recently used value or small
+    // delta from the last one, literal values take two more nibbles.
+    // The frame is committed by its last nibble and padded to the
+    // byte boundary, so it can be sent right away. Pack command
+    // resets the model, the exit nibble returns to the byte stream.
+    // The transport is optional, Info reports it in the features.
+    //
+    // Packets protect frames on fast and noisy links: the header and
+    // the length are followed by the payload of one frame (pairs or
+    // bitmask frame, or a single command) and CRC-16 of all the bytes
+    // before it (XMODEM, LE). Writes and the command of the payload
+    // are held back until the CRC has been checked, so a corrupted
+    // frame never reaches PSG. The first packet header switches the
+    // device to checked mode: bytes outside of packets are skipped,
+    // so after a bad packet (dropped and counted) the device gets
+    // back in sync on the next header. A valid packet with empty
+    // payload returns to the plain stream.
+    //
+    // Timed writes go to PSG at the given offset from the start of
+    // the frame they are sent with (its commit on arrival, or its
+    // playback tick in queued mode), for effects faster than frames.
+    // They are raw writes like Write command and the device runs
+    // them from its timer interrupt.
+    //
+    // Digidrums are 4-bit samples played through the volume register
+    // of a channel. Sample command uploads them to the memory of the
+    // device (two samples per byte, the low nibble first), and Digi
+    // command starts playback of a part of that memory at the given
+    // sample period, so the timer interrupt of the device writes the
+    // volume while frames keep flowing. Looped playback lets the host
+    // stream samples, refilling the part that has been played.
+    // The sample memory is optional, Info reports it as well.
+    //
+    // Effects of YM6 tunes need writes at the rate of a timer, too
+    // fast for the link: SID voice toggles the volume of a channel
+    // between the given value and zero, sync buzzer writes the given
+    // shape to the envelope register, restarting the envelope. The
+    // host sends the descriptor of the effect when it changes, the
+    // device runs it from its timer interrupt until it is stopped.
+    //
+    // Sound effects of the AYFX bank kept by the device are started
+    // by Fx command: the low 6 bits are the number of the effect in
+    // the bank (Fx_Stop stops the channel), the high 2 bits are the
+    // channel (1-3 for A-C, 0 lets the device take the free one).
+    // Effects play a frame per period of the playback timer on top
+    // of the music, which gets its registers back after the effect.
+
+    enum class Cmd : uint8_t
+    {
+        Fx      = 0xEA, // effect (6 bits) + channel (2 bits) -> AYFX effect of the device bank
+        Effect  = 0xEB, // effect (see Effect enum), channel, period (2 bytes LE, us), volume or shape -> timer effect
+        Digi    = 0xEC, // channel, period (us), start, length (2 bytes LE each, bytes) -> sample playback
+        Sample  = 0xED, // position (2 bytes LE), length, data -> samples into the device memory
+        Timed   = 0xEE, // offset (2 bytes LE, us), addr, data -> raw write at the offset within the frame
+        Errors  = 0xEF, // -> reply: Errors, dropped packets, overruns (2 bytes LE each)
+        Packet  = 0xF0, // length (0-Packet_Max), payload, CRC-16 (2 bytes LE) -> checked frame or command
+        Pack    = 0xF1, // enable (0/1) -> packed transport, stream is nibbles until Pack_Exit
+        Instant = 0xF2, // reserved (1 byte), bytes are always decoded on arrival
+        Credit  = 0xF3, // enable (0/1) -> grants: Credit, bytes (up to Credit_Max per grant)
+        Sync    = 0xF4, // target fill (frames, 0 disables) -> reports: Sync, fill, trim (2 bytes LE, 1/65536)
+        Period  = 0xF5, // period (4 bytes LE, us) -> playback timer period of queued mode
+        Baud    = 0xF6, // baud (see Baud enum) -> reply: Baud, baud or 0xFF if refused
+        Info    = 0xF7, // -> reply: Info, info_t (packed, LE)
+        Frame16 = 0xF8, // mask (2 bytes LE), values -> bitmask frame of bank A
+        Frame32 = 0xF9, // mask (4 bytes LE), values -> bitmask frame of banks A and B
+        Read    = 0xFA, // addr -> reply: Read, data (raw read from PSG)
+        Write   = 0xFB, // addr, data (raw write to PSG, any address)
+        Reset   = 0xFC, // reset PSG and registers state
+        Clock   = 0xFD, // clock (4 bytes LE) -> reply: Clock, real clock (4 bytes LE)
+        Mode    = 0xFE, // mode (see Mode enum)
+        Frame   = 0xFF, // frame marker, commits the received registers
+    };
+
+    enum class Mode : uint8_t
+    {
+        Advanced = 0x00, // registers go through the Advanced pipeline
+        Raw      = 0x01, // registers go straight to PSG, frames are ignored
+        Queued   = 0x02, // frames are queued and played by timer of the device
+    };
+
+    enum class Effect : uint8_t
+    {
+        Stop   = 0x00, // stop the effect of the channel
+        Sid    = 0x01, // toggle the volume of the channel at each period
+        Buzzer = 0x02, // restart the envelope with the shape at each period
+    };
+
+    enum class Baud : uint8_t
+    {
+        B57600   = 0x00, // default rate after reset
+        B115200  = 0x01,
+        B250000  = 0x02, // rates from here on are exact for 16 MHz U2X
+        B500000  = 0x03,
+        B1000000 = 0x04,
+        B2000000 = 0x05,
+    };
+
+    // capabilities of the device reported by Info command
+    struct info_t
+    {
+        uint16_t version; // firmware version (major.minor in high.low byte)
+        uint32_t chipid;  // detected PSG (see ChipId enum)
+        uint32_t clock;   // real clock of PSG (Hz)
+        uint16_t buffer;  // size of RX buffer, the credit window (bytes)
+        uint8_t  bauds;   // mask of supported baud rates (bit per Baud)
+        uint8_t  features; // optional features built in (see Feature enum)
+    };
+
+    enum // optional features of the device, bits of info_t
+    {
+        Feature_Pack    = 0x01, // packed transport (Pack command)
+        Feature_Samples = 0x02, // sample memory (Sample and Digi commands)
+    };
+
+    enum
+    {
+        Info_Size     = 14,    // size of packed info_t in the reply
+        Sync_Interval = 64,    // frames between fill level reports of queued mode
+        Credit_Max    = 0x7F,  // max bytes granted by one credit message
+        Packet_Max    = 32,    // max payload of the packet (bytes)
+        Sample_Size   = 512,   // sample memory of the device (bytes, two samples each)
+        Digi_Stop     = 0x03,  // channel of Digi command that stops playback
+        Digi_Loop     = 0x80,  // flag of the channel to loop the sample
+        Fx_Stop       = 0x3F,  // effect of Fx command that stops the channel
+        tConfirm      = 1000,  // baud rate switch confirmation time (milli seconds)
+        tPeriod       = 20000  // default playback period of queued mode (micro seconds)
+    };
+
+    // CRC-16 of packets (polynomial 0x1021, initial value 0)
+    uint16_t crc16(uint16_t crc, uint8_t data);
+
+    inline uint32_t toBaudRate(Baud baud)
+    {
+        switch (baud)
+        {
+            case Baud::B57600:   return 57600;
+            case Baud::B115200:  return 115200;
+            case Baud::B250000:  return 250000;
+            case Baud::B500000:  return 500000;
+            case Baud::B1000000: return 1000000;
+            case Baud::B2000000: return 2000000;
+        }
+        return 0;
+    }
+
+    enum
+    {
+        Reg_Lst  = 0x0F, // numeric value of the last register in stream
+        Char_Fst = 0x20, // first printable char of the input string
+        Char_Lst = 0x7F, // last printable char of the input string
+        Cmd_Fst  = 0xEA, // numeric value of the first command
+    };
+
+    enum // nibble codes of packed transport
+    {
+        Pack_Masks   = 0x0C, // header 0x0-0xB: index of recently used mask
+        Pack_Empty   = 0x0C, // header: empty frame
+        Pack_Pad     = 0x0D, // header: padding to the byte boundary
+        Pack_Mask    = 0x0E, // header: new mask follows (4 nibbles, 16 bits LE)
+        Pack_Exit    = 0x0F, // header: back to the byte stream
+        Pack_Values  = 0x08, // value 0x0-0x7: index of recently used value
+        Pack_Delta   = 0x03, // value 0x8-0xD: delta +1..+3, -1..-3 from the last value
+        Pack_Literal = 0x0E, // value 0xE-0xF: literal follows (2 nibbles)
+    };
+}
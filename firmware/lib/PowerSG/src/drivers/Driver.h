@@ -15,5 +15,8 @@ namespace PowerSG
         virtual void chip_address(uint8_t addr) = 0;
         virtual void chip_write(uint8_t data) = 0;
         virtual void chip_read(uint8_t &data) = 0;
+
+        // push out the writes buffered by the driver
+        virtual void chip_flush() {}
     };
 }
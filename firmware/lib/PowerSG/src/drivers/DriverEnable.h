@@ -16,3 +16,7 @@
 // #if defined(__AVR_ATmega8A__) || defined(__AVR_ATmega8__)
 // #define USE_M328_PDRIVER
 // #endif
+
+#if defined(__linux__)
+#define USE_LINUX_SDRIVER
+#endif
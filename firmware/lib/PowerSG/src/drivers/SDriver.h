@@ -1,3 +1,8 @@
 #pragma once
 
-// TODO
+#include "drivers/DriverEnable.h"
+
+#ifdef USE_LINUX_SDRIVER
+#include "drivers/serial/linux_driver.h"
+namespace PowerSG { using SDriver = linux_driver; }
+#endif
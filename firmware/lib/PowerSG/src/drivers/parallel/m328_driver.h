@@ -1,10 +1,15 @@
 #pragma once
 
 #include "drivers/Driver.h"
+#include "m328_wiring.h"
+
+#include <util/delay.h>
 
 namespace PowerSG
 {
-    class m328_driver : public Driver
+    // the bus operations are defined inline, so they compile into
+    // port I/O where the driver type is bound to the pipeline
+    class m328_driver final : public Driver
     {
     public:
         void chip_power_on() override;
@@ -19,5 +24,97 @@ namespace PowerSG
     private:
         uint8_t m_clockDiv { 0 };
     };
-}
 
+    // details of the bus, kept out of the namespace of the library
+    namespace m328
+    {
+        enum // timing delays (nano seconds)
+        {
+            tAS = 400, // Address Setup Time
+            tAH = 100, // Address Hold Time
+            tDW = 500, // Write Data Pulse Width
+            tDH = 100, // Write Data Hold Time
+            tDA = 400, // Read Data Access Time
+            tTS = 100, // Tristate Delay Time
+            tRW = 500, // Reset Pulse Width
+            tRB = 100  // Reset to Bus Control Delay Time
+        };
+
+        constexpr uint8_t BUS_MASK = (1 << BUS_BDIR | 1 << BUS_BC1);
+
+        template<uint16_t ns>
+        inline void wait_for_delay()
+        {
+            // the delay must be known at compile time
+            _delay_us(0.001f * ns);
+        }
+
+        inline void set_data_bus(uint8_t data)
+        {
+            // set ports to output
+            lsb_ddr() |= LSB_MASK;
+            msb_ddr() |= MSB_MASK;
+
+            // set data bits to output ports
+            lsb_port() = (lsb_port() & ~LSB_MASK) | (data & LSB_MASK);
+            msb_port() = (msb_port() & ~MSB_MASK) | (data & MSB_MASK);
+        }
+
+        inline void get_data_bus(uint8_t& data)
+        {
+            // get bata bits from input ports
+            data = (lsb_pin() & LSB_MASK) | (msb_pin() & MSB_MASK);
+        }
+
+        inline void release_data_bus()
+        {
+            // setup ports to input
+            lsb_ddr() &= ~LSB_MASK;
+            msb_ddr() &= ~MSB_MASK;
+
+            // enable pull-up resistors
+            lsb_port() |= LSB_MASK;
+            msb_port() |= MSB_MASK;
+        }
+
+        inline void set_ctrl_bus_addr()  { bus_port() = (bus_port() & ~BUS_MASK) | 1 << BUS_BDIR | 1 << BUS_BC1; }
+        inline void set_ctrl_bus_write() { bus_port() = (bus_port() & ~BUS_MASK) | 1 << BUS_BDIR; }
+        inline void set_ctrl_bus_read()  { bus_port() = (bus_port() & ~BUS_MASK) | 1 << BUS_BC1;  }
+        inline void set_ctrl_bus_inact() { bus_port() = (bus_port() & ~BUS_MASK); }
+    }
+
+    inline void m328_driver::chip_address(uint8_t addr)
+    {
+        // 'Latch Address' sequence
+        using namespace m328;
+        set_ctrl_bus_addr();
+        set_data_bus(addr);
+        wait_for_delay<tAS>();
+        set_ctrl_bus_inact();
+        wait_for_delay<tAH>();
+        release_data_bus();
+    }
+
+    inline void m328_driver::chip_write(uint8_t data)
+    {
+        // 'Write to PSG' sequence
+        using namespace m328;
+        set_data_bus(data);
+        set_ctrl_bus_write();
+        wait_for_delay<tDW>();
+        set_ctrl_bus_inact();
+        wait_for_delay<tDH>();
+        release_data_bus();
+    }
+
+    inline void m328_driver::chip_read(uint8_t &data)
+    {
+        // 'Read from PSG' sequence
+        using namespace m328;
+        set_ctrl_bus_read();
+        wait_for_delay<tDA>();
+        get_data_bus(data);
+        set_ctrl_bus_inact();
+        wait_for_delay<tTS>();
+    }
+}
@@ -26,26 +26,32 @@
 
 #include <avr/io.h>
 
-// data bus bits DA0-DA3 (Arduino pins A0-A3)
-#define LSB_DDR  DDRC
-#define LSB_PIN  PINC
-#define LSB_PORT PORTC
-#define LSB_MASK 0b00001111
+namespace PowerSG
+{
+    namespace m328
+    {
+        // data bus bits DA0-DA3 (Arduino pins A0-A3)
+        inline volatile uint8_t& lsb_ddr()  { return DDRC;  }
+        inline volatile uint8_t& lsb_pin()  { return PINC;  }
+        inline volatile uint8_t& lsb_port() { return PORTC; }
+        constexpr uint8_t LSB_MASK = 0b00001111;
 
-// data bus bits DA4-DA7 (Arduino pins D4-D7)
-#define MSB_DDR  DDRD
-#define MSB_PIN  PIND
-#define MSB_PORT PORTD
-#define MSB_MASK 0b11110000
+        // data bus bits DA4-DA7 (Arduino pins D4-D7)
+        inline volatile uint8_t& msb_ddr()  { return DDRD;  }
+        inline volatile uint8_t& msb_pin()  { return PIND;  }
+        inline volatile uint8_t& msb_port() { return PORTD; }
+        constexpr uint8_t MSB_MASK = 0b11110000;
 
-// control bus BC1 and BDIR signals
-#define BUS_DDR  DDRB
-#define BUS_PORT PORTB
-#define BUS_BC1  PB0    // Arduino pin D8
-#define BUS_BDIR PB1    // Arduino pin D9
+        // control bus BC1 and BDIR signals
+        inline volatile uint8_t& bus_ddr()  { return DDRB;  }
+        inline volatile uint8_t& bus_port() { return PORTB; }
+        constexpr uint8_t BUS_BC1  = PB0; // Arduino pin D8
+        constexpr uint8_t BUS_BDIR = PB1; // Arduino pin D9
 
-// #RESET and CLOCK signals
-#define SIG_DDR  DDRD
-#define SIG_PORT PORTD
-#define SIG_RES  PD2    // Arduino pin D2
-#define SIG_CLK  PD3    // Arduino pin D3
+        // #RESET and CLOCK signals
+        inline volatile uint8_t& sig_ddr()  { return DDRD;  }
+        inline volatile uint8_t& sig_port() { return PORTD; }
+        constexpr uint8_t SIG_RES = PD2; // Arduino pin D2
+        constexpr uint8_t SIG_CLK = PD3; // Arduino pin D3
+    }
+}
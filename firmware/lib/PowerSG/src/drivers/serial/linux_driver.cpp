@@ -0,0 +1,297 @@
+#include "drivers/DriverEnable.h"
+#if defined(USE_LINUX_SDRIVER)
+
+#include "linux_driver.h"
+
+namespace PowerSG
+{
+    enum // reply timeouts (milli seconds)
+    {
+        tReply = 250, // Request to Reply Time
+        tAlive = 3000 // Port Open to Device Alive Time (includes reset by DTR)
+    };
+
+    linux_driver::linux_driver()
+        : m_encoder(m_buffer, sizeof(m_buffer))
+        , m_addr(0)
+        , m_clock(0)
+        , m_baud(0)
+        , m_credit(0)
+        , m_flow(false)
+        , m_grant(false)
+        , m_skip(0)
+    {}
+
+    bool linux_driver::open(const char* path, uint32_t baud)
+    {
+        if (!m_serial.open(path, baud)) return false;
+        m_baud = baud;
+        m_flow = false;
+        m_grant = false;
+        m_skip = 0;
+
+        // the board may reboot on port opening
+        if (probe(tAlive)) return true;
+        m_serial.close();
+        return false;
+    }
+
+    void linux_driver::close()
+    {
+        m_serial.close();
+    }
+
+    linux_serial& linux_driver::serial()
+    {
+        return m_serial;
+    }
+
+    bool linux_driver::get_info(info_t& info)
+    {
+        uint8_t data[Info_Size];
+        m_encoder.putCommand(Cmd::Info);
+        if (!send() || !receive(Cmd::Info, data, sizeof(data))) return false;
+
+        info.version = uint16_t(data[0] | data[1] << 8);
+        info.chipid  = uint32_t(data[2]) | uint32_t(data[3]) << 8 | uint32_t(data[4]) << 16 | uint32_t(data[5]) << 24;
+        info.clock   = uint32_t(data[6]) | uint32_t(data[7]) << 8 | uint32_t(data[8]) << 16 | uint32_t(data[9]) << 24;
+        info.buffer  = uint16_t(data[10] | data[11] << 8);
+        info.bauds   = data[12];
+        info.features = data[13];
+        return true;
+    }
+
+    bool linux_driver::set_baud(Baud baud)
+    {
+        uint8_t args[] = { uint8_t(baud) }, data;
+        uint32_t rate = toBaudRate(baud);
+
+        // device replies at the current rate and switches
+        m_encoder.putCommand(Cmd::Baud, args, sizeof(args));
+        if (!send() || !receive(Cmd::Baud, &data, 1) || data != args[0]) return false;
+        if (rate == m_baud) return true;
+
+        // confirm the new rate with the same command
+        if (m_serial.set_baud(rate))
+        {
+            m_encoder.putCommand(Cmd::Baud, args, sizeof(args));
+            if (send() && receive(Cmd::Baud, &data, 1) && data == args[0])
+            {
+                m_baud = rate;
+                return true;
+            }
+        }
+
+        // wait for the device to fall back
+        m_serial.set_baud(m_baud);
+        probe(tConfirm + 2 * tReply);
+        return false;
+    }
+
+    bool linux_driver::get_errors(uint16_t& packets, uint16_t& overruns)
+    {
+        uint8_t data[4];
+        m_encoder.putCommand(Cmd::Errors);
+        if (!send() || !receive(Cmd::Errors, data, sizeof(data))) return false;
+
+        packets  = uint16_t(data[0] | data[1] << 8);
+        overruns = uint16_t(data[2] | data[3] << 8);
+        return true;
+    }
+
+    bool linux_driver::set_credit(bool enable)
+    {
+        info_t info;
+        if (enable && (!get_info(info) || info.buffer < 2)) return false;
+
+        uint8_t args[] = { uint8_t(enable) };
+        m_encoder.putCommand(Cmd::Credit, args, sizeof(args));
+        m_flow = false;
+        if (!send()) return false;
+        if (!enable) return true;
+
+        // the first grants give the whole free buffer
+        m_credit = 0;
+        m_flow = true;
+        uint8_t data;
+        while (m_credit < info.buffer - 1u && receive(Cmd::Credit, &data, 1)) m_credit += data;
+        m_flow = (m_credit == info.buffer - 1u);
+        return m_flow;
+    }
+
+    void linux_driver::input(const uint8_t* data, size_t size)
+    {
+        while (size--) collect(*data++);
+    }
+
+    uint32_t linux_driver::credit() const
+    {
+        return (m_flow ? m_credit : UINT32_MAX);
+    }
+
+    void linux_driver::spend(uint32_t bytes)
+    {
+        if (m_flow) m_credit -= bytes;
+    }
+
+    void linux_driver::chip_power_on()
+    {
+        uint8_t args[] = { uint8_t(Mode::Raw) };
+        m_encoder.putCommand(Cmd::Mode, args, sizeof(args));
+        send();
+    }
+
+    void linux_driver::chip_set_clock(uint32_t clock)
+    {
+        uint8_t args[4];
+        for (int i = 0; i < 4; ++i) args[i] = uint8_t(clock >> (8 * i));
+        m_encoder.putCommand(Cmd::Clock, args, sizeof(args));
+
+        // device replies with the real clock it has set
+        if (send() && receive(Cmd::Clock, args, sizeof(args)))
+        {
+            m_clock = 0;
+            for (int i = 0; i < 4; ++i) m_clock |= uint32_t(args[i]) << (8 * i);
+        }
+    }
+
+    void linux_driver::chip_get_clock(uint32_t &clock)
+    {
+        if (m_clock != 0)
+        {
+            clock = m_clock;
+        }
+    }
+
+    void linux_driver::chip_reset()
+    {
+        m_encoder.putCommand(Cmd::Reset);
+        send();
+    }
+
+    void linux_driver::chip_address(uint8_t addr)
+    {
+        m_addr = addr;
+    }
+
+    void linux_driver::chip_write(uint8_t data)
+    {
+        // plain pairs in raw mode are the shortest form,
+        // addresses out of stream range need a command
+        uint8_t args[] = { m_addr, data };
+        bool room = (m_addr <= Reg_Lst)
+            ? m_encoder.putRegister(m_addr, data)
+            : m_encoder.putCommand(Cmd::Write, args, sizeof(args));
+
+        if (!room)
+        {
+            send();
+            chip_write(data);
+        }
+    }
+
+    void linux_driver::chip_read(uint8_t &data)
+    {
+        uint8_t args[] = { m_addr };
+        if (!m_encoder.putCommand(Cmd::Read, args, sizeof(args)))
+        {
+            send();
+            m_encoder.putCommand(Cmd::Read, args, sizeof(args));
+        }
+        if (!send() || !receive(Cmd::Read, &data, 1)) data = 0xFF;
+    }
+
+    void linux_driver::chip_flush()
+    {
+        // the frame marker is ignored in raw mode, but
+        // keeps frame boundaries visible on the link
+        if (m_encoder.size())
+        {
+            if (!m_encoder.putFrame())
+            {
+                send();
+                m_encoder.putFrame();
+            }
+            send();
+        }
+    }
+
+    bool linux_driver::transmit(const uint8_t* data, uint16_t size)
+    {
+        while (size)
+        {
+            // wait for grants of the device when out of credits
+            uint8_t byte;
+            if (!credit())
+            {
+                if (m_serial.read(&byte, 1, tReply) != 1) return false;
+                collect(byte);
+                continue;
+            }
+
+            uint16_t part = uint16_t(size < credit() ? size : credit());
+            if (!m_serial.write(data, part)) return false;
+            spend(part);
+            data += part;
+            size -= part;
+        }
+        return true;
+    }
+
+    bool linux_driver::probe(int timeout)
+    {
+        // poll the device with reads until the first reply
+        uint8_t args[] = { 0x00 }, data;
+        for (int time = 0; time < timeout; time += tReply)
+        {
+            m_encoder.putCommand(Cmd::Read, args, sizeof(args));
+            if (send() && receive(Cmd::Read, &data, 1)) return true;
+        }
+        return false;
+    }
+
+    bool linux_driver::send()
+    {
+        bool sent = transmit(m_encoder.data(), m_encoder.size());
+        m_encoder.clear();
+        return sent;
+    }
+
+    bool linux_driver::receive(Cmd cmd, uint8_t* data, uint8_t size)
+    {
+        // skip everything before the reply (e.g. text output),
+        // a grant or a report being collected may look like one
+        uint8_t byte; int got = -1;
+        while (got < size && m_serial.read(&byte, 1, tReply) == 1)
+        {
+            if (got >= 0) data[got++] = byte;
+            else if (byte == uint8_t(cmd) && !m_skip && !m_grant) got = 0;
+            else collect(byte);
+        }
+        return (got == size);
+    }
+
+    void linux_driver::collect(uint8_t data)
+    {
+        // collect credits granted by the device, fill level
+        // reports of queued mode are skipped as a whole
+        if (m_skip)
+        {
+            m_skip--;
+        }
+        else if (m_grant)
+        {
+            m_credit += data;
+            m_grant = false;
+        }
+        else if (data == uint8_t(Cmd::Sync))
+        {
+            m_skip = 3;
+        }
+        else
+        {
+            m_grant = (m_flow && data == uint8_t(Cmd::Credit));
+        }
+    }
+}
+#endif
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "drivers/Driver.h"
+#include "drivers/serial/linux_serial.h"
+#include "details/stream/Encoder.h"
+
+namespace PowerSG
+{
+    // Driver of the PSG on the AYM Streamer connected to the Linux
+    // host. The device is switched to raw mode, so the pipeline runs
+    // on the host and the board only does raw register writes. Bus
+    // writes are batched into one serial write per flush (once per
+    // Advanced::update), reads are request/response round trips.
+    class linux_driver : public Driver
+    {
+    public:
+        linux_driver();
+
+        bool open(const char* path, uint32_t baud);
+        void close();
+        linux_serial& serial();
+
+        // query capabilities of the device and switch the link
+        // to the faster baud rate, falls back to the current one
+        bool get_info(info_t& info);
+        bool set_baud(Baud baud);
+
+        // query packets dropped as corrupted and bytes lost
+        // by the device before decoding (USART overruns)
+        bool get_errors(uint16_t& packets, uint16_t& overruns);
+
+        // credit flow control: blocking writes wait for credits,
+        // queued writers feed the input of the device to collect
+        // grants and spend credits on what they have written
+        bool set_credit(bool enable);
+        void input(const uint8_t* data, size_t size);
+        uint32_t credit() const;
+        void spend(uint32_t bytes);
+
+        void chip_power_on() override;
+        void chip_set_clock(uint32_t clock) override;
+        void chip_get_clock(uint32_t &clock) override;
+
+        void chip_reset() override;
+        void chip_address(uint8_t addr) override;
+        void chip_write(uint8_t data) override;
+        void chip_read(uint8_t &data) override;
+        void chip_flush() override;
+
+    protected:
+        // pass the batch of protocol bytes to the port,
+        // can be overridden to queue them instead
+        virtual bool transmit(const uint8_t* data, uint16_t size);
+
+    private:
+        bool probe(int timeout);
+        bool send();
+        bool receive(Cmd cmd, uint8_t* data, uint8_t size);
+        void collect(uint8_t data);
+
+    private:
+        linux_serial m_serial;
+        uint8_t  m_buffer[256];
+        Encoder  m_encoder;
+        uint8_t  m_addr;
+        uint32_t m_clock;
+        uint32_t m_baud;
+        uint32_t m_credit;
+        bool     m_flow;
+        bool     m_grant;
+        uint8_t  m_skip;
+    };
+}
@@ -0,0 +1,155 @@
+#include "drivers/DriverEnable.h"
+#if defined(USE_LINUX_SDRIVER)
+
+#include "linux_serial.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+// kernel termios with arbitrary rates (BOTHER), glibc
+// has no declaration that could be used with <termios.h>
+struct termios2
+{
+    tcflag_t c_iflag, c_oflag, c_cflag, c_lflag;
+    cc_t     c_line, c_cc[19];
+    speed_t  c_ispeed, c_ospeed;
+};
+
+#ifndef BOTHER
+#define BOTHER  0010000
+#endif
+#ifndef IBSHIFT
+#define IBSHIFT 16
+#endif
+
+namespace PowerSG
+{
+    static bool set_custom_speed(int fd, uint32_t baud)
+    {
+    #if defined(TCGETS2)
+        termios2 tio;
+        if (ioctl(fd, TCGETS2, &tio)) return false;
+        tio.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+        tio.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+        tio.c_ispeed = baud;
+        tio.c_ospeed = baud;
+        return (ioctl(fd, TCSETS2, &tio) == 0);
+    #else
+        return false;
+    #endif
+    }
+
+    static speed_t to_speed(uint32_t baud)
+    {
+        switch (baud)
+        {
+        case 9600:    return B9600;
+        case 19200:   return B19200;
+        case 38400:   return B38400;
+        case 57600:   return B57600;
+        case 115200:  return B115200;
+        case 230400:  return B230400;
+        case 460800:  return B460800;
+        case 500000:  return B500000;
+        case 921600:  return B921600;
+        case 1000000: return B1000000;
+        case 1500000: return B1500000;
+        case 2000000: return B2000000;
+        default:      return B0;
+        }
+    }
+
+    linux_serial::linux_serial()
+        : m_fd(-1)
+    {}
+
+    linux_serial::~linux_serial()
+    {
+        close();
+    }
+
+    bool linux_serial::open(const char* path, uint32_t baud)
+    {
+        close();
+        m_fd = ::open(path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+        if (m_fd < 0) return false;
+
+        termios tio;
+        if (tcgetattr(m_fd, &tio) == 0)
+        {
+            cfmakeraw(&tio);
+            tio.c_cflag |= (CLOCAL | CREAD);
+            tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+            tio.c_cc[VMIN]  = 0;
+            tio.c_cc[VTIME] = 0;
+            if (tcsetattr(m_fd, TCSANOW, &tio) == 0 && set_baud(baud))
+            {
+                tcflush(m_fd, TCIOFLUSH);
+                return true;
+            }
+        }
+        close();
+        return false;
+    }
+
+    bool linux_serial::set_baud(uint32_t baud)
+    {
+        termios tio;
+        speed_t speed = to_speed(baud);
+        if (!baud || tcgetattr(m_fd, &tio)) return false;
+
+        // wait for pending output sent at the old rate,
+        // rates without Bxxx constant are set directly
+        tcdrain(m_fd);
+        if (speed == B0) return set_custom_speed(m_fd, baud);
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+        return (tcsetattr(m_fd, TCSANOW, &tio) == 0);
+    }
+
+    void linux_serial::close()
+    {
+        if (m_fd >= 0) ::close(m_fd);
+        m_fd = -1;
+    }
+
+    int linux_serial::fd() const
+    {
+        return m_fd;
+    }
+
+    bool linux_serial::write(const uint8_t* data, size_t size)
+    {
+        while (size)
+        {
+            ssize_t n = ::write(m_fd, data, size);
+            if (n < 0)
+            {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN) return false;
+
+                // descriptor may be non-blocking
+                pollfd pfd { m_fd, POLLOUT, 0 };
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            data += n; size -= n;
+        }
+        return true;
+    }
+
+    int linux_serial::read(uint8_t* data, size_t size, int timeout)
+    {
+        pollfd pfd { m_fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, timeout);
+        if (ready <= 0) return ready;
+
+        ssize_t n = ::read(m_fd, data, size);
+        return (n < 0 ? (errno == EAGAIN ? 0 : -1) : int(n));
+    }
+}
+#endif
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace PowerSG
+{
+    // Serial port of the AYM Streamer on the Linux host
+    // (raw mode, 8N1, no flow control)
+    class linux_serial
+    {
+    public:
+        linux_serial();
+        ~linux_serial();
+
+        bool open(const char* path, uint32_t baud);
+        bool set_baud(uint32_t baud);
+        void close();
+        int  fd() const;
+
+        // write all data, blocking until the kernel accepted it
+        bool write(const uint8_t* data, size_t size);
+
+        // read available data waiting up to timeout (ms),
+        // returns number of bytes read or -1 on error
+        int read(uint8_t* data, size_t size, int timeout);
+
+    private:
+        int m_fd;
+    };
+}
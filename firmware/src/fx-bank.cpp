@@ -0,0 +1,25 @@
+#include "fx-bank.h"
+
+// demo effects, replace with the bank of the application:
+// xxd -i bank.afb gives the bytes to put here
+const uint8_t fx_bank[] PROGMEM =
+{
+    4, // number of effects
+    0x07, 0x00, 0x10, 0x00, 0x21, 0x00, 0x45, 0x00, // offsets
+    // shot
+    0x5F, 0x06, 0x1D, 0x1B, 0x19, 0x17, 0x15, 0x13, 0x11, 0xD0, 0x20,
+    // coin
+    0xAE, 0xA0, 0x00, 0x8E, 0x8D, 0xAE, 0x78, 0x00, 0x8D, 0x8C, 0x8B, 0x8A,
+    0x89, 0x88, 0x86, 0x84, 0x82, 0xD0, 0x20,
+    // jump
+    0xAD, 0x00, 0x02, 0xAD, 0xD8, 0x01, 0xAD, 0xB0, 0x01, 0xAC, 0x88, 0x01,
+    0xAC, 0x60, 0x01, 0xAC, 0x38, 0x01, 0xAB, 0x10, 0x01, 0xAB, 0xE8, 0x00,
+    0xAB, 0xC0, 0x00, 0xAA, 0x98, 0x00, 0xAA, 0x70, 0x00, 0xAA, 0x48, 0x00,
+    0xD0, 0x20,
+    // explosion
+    0x5F, 0x1F, 0x5F, 0x10, 0x5E, 0x11, 0x5E, 0x11, 0x5D, 0x12, 0x5C, 0x12,
+    0x5C, 0x13, 0x5B, 0x13, 0x5A, 0x14, 0x5A, 0x14, 0x59, 0x15, 0x59, 0x15,
+    0x58, 0x16, 0x57, 0x16, 0x57, 0x17, 0x56, 0x17, 0x55, 0x18, 0x55, 0x18,
+    0x54, 0x19, 0x54, 0x19, 0x53, 0x1A, 0x52, 0x1A, 0x52, 0x1B, 0x51, 0x1B,
+    0x50, 0x1C, 0xD0, 0x20,
+};
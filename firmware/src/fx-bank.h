@@ -0,0 +1,7 @@
+#pragma once
+
+#include <avr/pgmspace.h>
+
+// bank of sound effects started by Fx command, the
+// .afb file of AYFX editor as is (see fx-bank.cpp)
+extern const uint8_t fx_bank[] PROGMEM;
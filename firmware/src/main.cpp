@@ -1,30 +1,55 @@
 #include <Arduino.h>
 #include <PowerSG.h>
+#include "uart-stream.h"
+#include "fx-bank.h"
 
-PowerSG::PDriver  m_driver;
-PowerSG::Simple   m_psg1(m_driver);
-PowerSG::Advanced m_psg2(m_driver);
+PowerSG::PDriver m_driver;
+uart_stream::PSG m_psg(m_driver);
 
-void setup()
+void inputHandler(const char* str)
 {
-    m_psg1.begin();
-    m_psg1.setClock(1750000);
+    UARTStream.Print(F("echo: "));
+    UARTStream.Println(str);
+}
 
-    m_psg2.begin();
-    m_psg2.setClock(PowerSG::F1_75MHZ);
-    m_psg2.setStereo(PowerSG::Stereo::ABC);
-    m_psg2.update();
+void setup()
+{
+    // power on and configure PSG
+    m_psg.begin();
+    m_psg.setClock(PowerSG::F1_75MHZ);
+    m_psg.setStereo(PowerSG::Stereo::ABC);
 
-    PowerSG::ChipId chipId1 = m_psg1.getChipId();
-    PowerSG::ChipId chipId2 = m_psg2.getChipId();
+    // start and configure UART stream
+    UARTStream.Start(m_psg);
+    UARTStream.SetInputHandler(inputHandler);
+    UARTStream.SetEffects(fx_bank);
 
-    constexpr auto sz1 = sizeof(PowerSG::Simple);
-    constexpr auto sz2 = sizeof(PowerSG::Advanced);
+    // print firmware wellcome
+    UARTStream.Println('-', 4 + 12 + 4);
+    UARTStream.Print  (' ', 4); UARTStream.Println(F("AYM STREAMER"));
+    UARTStream.Print  (' ', 4); UARTStream.Println(F("FW: v3.0"));
+    UARTStream.Println('-', 4 + 12 + 4);
 
-    // TODO
+    // print PSG info
+    UARTStream.Print(F("hash:\t"));
+    UARTStream.Println(uint32_t(m_psg.getChipId()), true);
+    UARTStream.Print(F("chip:\t"));
+    switch(m_psg.getChipId())
+    {
+    case PowerSG::ChipId::NotFound:   UARTStream.Println(F( "Not Found!"       )); break;
+    case PowerSG::ChipId::Compatible: UARTStream.Println(F( "AY/YM Compatible" )); break;
+    case PowerSG::ChipId::AY8910:     UARTStream.Println(F( "AY-3-8910"        )); break;
+    case PowerSG::ChipId::AY8930:     UARTStream.Println(F( "Microchip AY8930" )); break;
+    case PowerSG::ChipId::YM2149F:    UARTStream.Println(F( "Yamaha YM2149F"   )); break;
+    default:                          UARTStream.Println(F( "Bad or Unknown!"  )); break;
+    }
+    UARTStream.Print(F("clock:\t"));
+    UARTStream.Println(m_psg.getClock());
 }
 
 void loop()
 {
-    // TODO
+    // stream is decoded by interrupt, PSG
+    // updates and replies are done here
+    UARTStream.Update();
 }
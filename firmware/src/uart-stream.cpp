@@ -0,0 +1,713 @@
+#include "uart-stream.h"
+#include <PowerSG.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+// report the worst time of RX interrupt once a second
+// #define ENABLE_ISR_PROFILING
+
+// sample memory of digidrums, takes Sample_Size bytes of RAM
+#define ENABLE_SAMPLE_MEMORY
+
+// shared class instance
+uart_stream UARTStream;
+
+// stream decoder forwarding input strings to handler
+// and replies to the host
+class uart_decoder : public PowerSG::Decoder
+{
+public:
+    using PowerSG::Decoder::Decoder;
+    uart_stream::Handler m_handler = nullptr;
+
+protected:
+    void on_input_string(const char* str) override;
+    void on_output(const uint8_t* data, uint8_t size) override;
+    void on_info(PowerSG::info_t& info) override;
+    void on_baud(PowerSG::Baud baud) override;
+    void on_period(uint32_t period) override;
+    void on_timed(uint16_t offset, PowerSG::raddr_t addr, PowerSG::rdata_t data) override;
+#ifdef ENABLE_SAMPLE_MEMORY
+    void on_sample(uint16_t pos, uint8_t data) override;
+    void on_digi(const PowerSG::digi_t& digi) override;
+#endif
+    void on_effect(const PowerSG::effect_t& effect) override;
+    void on_fx(uint8_t effect, uint8_t channel) override;
+};
+
+// shared references and objects
+static uart_decoder* m_decoder = nullptr;
+static uart_stream::PSG* m_chip = nullptr;
+static PowerSG::FxPlayer* m_fx = nullptr;
+
+// stream is decoded by RX interrupt, the rest is
+// deferred to the main loop, messages are kept whole
+static char m_line[64];                // input string for handler
+static volatile bool m_input;          // input string is pending
+static uint8_t m_reply[32];            // replies to send to the host
+static volatile uint8_t m_rsize;       // size of pending replies
+
+// baud rate switching
+static const uint16_t m_update = 5000; // service timer period (us)
+static volatile uint16_t m_switch;     // divisor to switch to
+static volatile bool m_pending;        // switching is pending
+static uint16_t m_ubrr;                // divisor to fall back to
+static volatile uint8_t m_fallback;    // ticks left to confirm new rate
+
+// playback of queued frames
+static uint32_t m_frame;               // playback timer period (counts)
+static uint32_t m_left;                // counts left to the next frame
+static volatile uint8_t m_ticks;       // playback ticks to run
+
+// sound effects are started by the main loop
+struct fx_start_t { uint8_t effect; uint8_t channel; };
+static fx_start_t m_fxq[4];            // effects to start
+static volatile uint8_t m_fxhead;      // next effect to start
+static volatile uint8_t m_fxtail;      // end of effects to start
+
+// timed writes sorted by due time, channel A of the timer
+// fires at the first one or at the service tick if earlier
+struct timed_write_t { uint32_t due; uint8_t addr; uint8_t data; };
+static timed_write_t m_writes[16];
+static uint8_t  m_nwrites;             // number of scheduled writes
+static uint32_t m_base;                // time of the last service tick (counts)
+static uint32_t m_service;             // time of the next service tick (counts)
+static const uint8_t m_lead = 32;      // writes due sooner are done at once (counts)
+
+static const uint8_t m_pmin = 40;      // shortest period of samples and effects (us)
+
+#ifdef ENABLE_SAMPLE_MEMORY
+// sample playback, channel A of the timer also
+// fires at the next sample written to the volume
+static uint8_t  m_samples[PowerSG::Sample_Size]; // two samples per byte
+static bool     m_digi;                // playback is running
+static bool     m_dloop;               // sample is looped
+static uint8_t  m_dreg;                // volume register of the channel
+static uint16_t m_dpos;                // next sample (nibbles)
+static uint16_t m_dstart;              // start of the sample (nibbles)
+static uint16_t m_dend;                // end of the sample (nibbles)
+static uint16_t m_dstep;               // sample period (counts)
+static uint32_t m_ddue;                // time of the next sample (counts)
+#endif
+
+// timer effects of the channels, also on channel A
+struct effect_state_t
+{
+    uint32_t due;                      // time of the next write (counts)
+    uint32_t step;                     // period of writes (counts), 0 if stopped
+    uint8_t  reg;                      // register to write
+    uint8_t  data;                     // volume or envelope shape
+    bool     sid;                      // SID voice, otherwise sync buzzer
+    bool     on;                       // SID volume is on
+};
+static effect_state_t m_effects[3];
+
+#ifdef ENABLE_ISR_PROFILING
+static volatile uint16_t m_isr_max;    // longest run of RX interrupt (counts)
+static uint16_t m_commit_max;          // longest frame commit of main loop (counts)
+static volatile uint8_t  m_report;     // service ticks left to report
+#endif
+
+// -----------------------------------------------------------------------------
+
+static uint16_t uart_ubrr(uint32_t baud)
+{
+    // divisor of double speed mode rounded to nearest,
+    // exact for 250000-2000000 baud at 16 MHz
+    return uint16_t((F_CPU / 4 / baud - 1) / 2);
+}
+
+static void uart_begin(uint32_t baud)
+{
+    // double speed mode, 8N1 frame format
+    UCSR0A = (1 << U2X0);
+    UBRR0  = uart_ubrr(baud);
+    UCSR0C = (1 << UCSZ01) | (1 << UCSZ00);
+    UCSR0B = (1 << RXEN0) | (1 << TXEN0) | (1 << RXCIE0);
+}
+
+static void uart_end()
+{
+    UCSR0B = 0;
+}
+
+static void uart_write(uint8_t data)
+{
+    // clear transmit complete flag along with the write
+    while (!(UCSR0A & (1 << UDRE0)));
+    UCSR0A = (1 << U2X0) | (1 << TXC0);
+    UDR0 = data;
+}
+
+static void uart_flush()
+{
+    // wait until the last byte has left the shift register
+    while (!(UCSR0A & (1 << TXC0)));
+}
+
+static void uart_baud(uint16_t ubrr)
+{
+    uart_flush();
+    UBRR0 = ubrr;
+}
+
+static void uart_reply()
+{
+    // take pending replies and send them with interrupts enabled
+    uint8_t reply[sizeof(m_reply)], size;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        size = m_rsize;
+        memcpy(reply, m_reply, size);
+        m_rsize = 0;
+    }
+    for (uint8_t i = 0; i < size; ++i) uart_write(reply[i]);
+}
+
+static inline uint32_t timer_counts(uint32_t period_us)
+{
+    // prescaler 8 gives 0.5 us per count at 16 MHz
+    return (F_CPU / 8 / 1000000 * period_us);
+}
+
+static inline uint32_t timer_now()
+{
+    // extend the timer by the time of the last service tick, it is
+    // less than the timer range ago (call with interrupts disabled)
+    return m_base + uint16_t(TCNT1 - uint16_t(m_base));
+}
+
+static void timer_schedule()
+{
+    // the first timed write or the next sample
+    // if it comes before the service tick
+    uint32_t next = m_service;
+    if (m_nwrites && int32_t(m_writes[0].due - next) < 0) next = m_writes[0].due;
+#ifdef ENABLE_SAMPLE_MEMORY
+    if (m_digi && int32_t(m_ddue - next) < 0) next = m_ddue;
+#endif
+    for (const effect_state_t& fx : m_effects)
+    {
+        if (fx.step && int32_t(fx.due - next) < 0) next = fx.due;
+    }
+    OCR1A = uint16_t(next);
+}
+
+static void timer_start()
+{
+    // free running timer, channel A for service ticks, timed
+    // writes, samples and effects, channel B for frames playback
+    m_base = 0;
+    m_service = timer_counts(m_update);
+    m_nwrites = 0;
+#ifdef ENABLE_SAMPLE_MEMORY
+    m_digi = false;
+#endif
+    memset(m_effects, 0, sizeof(m_effects));
+    TCCR1A = 0;
+    TCCR1B = 0;
+    TCNT1  = 0;
+    OCR1A  = uint16_t(m_service);
+    OCR1B  = uint16_t(timer_counts(m_update) / 2);
+    TIFR1  = (1 << OCF1A) | (1 << OCF1B);
+    TIMSK1 = (1 << OCIE1A) | (1 << OCIE1B);
+    TCCR1B = (1 << CS11);
+}
+
+static void timer_stop()
+{
+    TIMSK1 = 0;
+    TCCR1B = 0;
+}
+
+// -----------------------------------------------------------------------------
+
+void uart_decoder::on_input_string(const char* str)
+{
+    // handler prints, so it is called from the main loop,
+    // strings arriving before that one are dropped
+    if (!m_input)
+    {
+        strcpy(m_line, str);
+        m_input = true;
+    }
+}
+
+void uart_decoder::on_output(const uint8_t* data, uint8_t size)
+{
+    // called by RX interrupt and the main loop
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (m_rsize + size <= sizeof(m_reply))
+        {
+            memcpy(m_reply + m_rsize, data, size);
+            m_rsize += size;
+        }
+    }
+}
+
+void uart_decoder::on_info(PowerSG::info_t& info)
+{
+    info.version = 0x0300;
+
+    // rates up to 500 kbaud, where a byte takes 20 us; at 1 and 2 Mbaud
+    // the 10 and 5 us are less than decoding, bank B writes and timer
+    // interrupts keep the RX interrupt waiting, so bytes would be lost
+    info.bauds   = uint8_t((2 << uint8_t(PowerSG::Baud::B500000)) - 1);
+#ifdef ENABLE_SAMPLE_MEMORY
+    info.features |= PowerSG::Feature_Samples;
+#endif
+}
+
+void uart_decoder::on_baud(PowerSG::Baud baud)
+{
+    uint16_t ubrr = uart_ubrr(PowerSG::toBaudRate(baud));
+    if (ubrr == UBRR0)
+    {
+        // the host has confirmed the new rate
+        m_fallback = 0;
+    }
+    else
+    {
+        // switch after the reply has been sent
+        m_switch = ubrr;
+        m_pending = true;
+    }
+}
+
+void uart_decoder::on_period(uint32_t period)
+{
+    // takes effect from the next frame
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        m_frame = timer_counts(period);
+    }
+}
+
+void uart_decoder::on_timed(uint16_t offset, PowerSG::raddr_t addr, PowerSG::rdata_t data)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        uint32_t due = timer_now() + timer_counts(offset);
+        if (offset < m_lead / 2 || m_nwrites == sizeof(m_writes) / sizeof(m_writes[0]))
+        {
+            // too close to schedule (or no room left)
+            m_chip->writeRegister(addr, data);
+        }
+        else
+        {
+            // insert after the writes due earlier or at the same time
+            uint8_t i = m_nwrites++;
+            for (; i && int32_t(m_writes[i - 1].due - due) > 0; --i) m_writes[i] = m_writes[i - 1];
+            m_writes[i] = { due, addr, data };
+            timer_schedule();
+        }
+    }
+}
+
+#ifdef ENABLE_SAMPLE_MEMORY
+void uart_decoder::on_sample(uint16_t pos, uint8_t data)
+{
+    if (pos < sizeof(m_samples)) m_samples[pos] = data;
+}
+
+void uart_decoder::on_digi(const PowerSG::digi_t& digi)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        // the sample is clipped to the memory, the
+        // volume is left as the last sample has set it
+        uint16_t start = (digi.start < sizeof(m_samples) ? digi.start : sizeof(m_samples));
+        uint16_t length = (digi.length < sizeof(m_samples) - start ? digi.length : sizeof(m_samples) - start);
+        m_digi = (digi.channel != PowerSG::Digi_Stop && length);
+        if (m_digi)
+        {
+            m_dloop  = digi.loop;
+            m_dreg   = uint8_t(PowerSG::Reg::A_Volume) + digi.channel;
+            m_dstart = 2 * start;
+            m_dend   = 2 * (start + length);
+            m_dpos   = m_dstart;
+            m_dstep  = uint16_t(timer_counts(digi.period > m_pmin ? digi.period : m_pmin));
+            m_ddue   = timer_now() + m_lead;
+        }
+        timer_schedule();
+    }
+}
+#endif
+
+void uart_decoder::on_effect(const PowerSG::effect_t& effect)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        effect_state_t& fx = m_effects[effect.channel];
+        if (effect.kind == PowerSG::Effect::Stop)
+        {
+            // stopped SID voice leaves the volume on
+            if (fx.step && fx.sid) m_chip->writeRegister(fx.reg, fx.data);
+            fx.step = 0;
+        }
+        else
+        {
+            // changes of the running effect keep its phase
+            bool sid = (effect.kind == PowerSG::Effect::Sid);
+            if (!fx.step || fx.sid != sid)
+            {
+                fx.due = timer_now() + m_lead;
+                fx.on  = false;
+            }
+            fx.sid  = sid;
+            fx.reg  = (sid ? uint8_t(PowerSG::Reg::A_Volume) + effect.channel : uint8_t(PowerSG::Reg::EA_Shape));
+            fx.data = (sid ? effect.data : effect.data & 0x0F);
+            fx.step = timer_counts(effect.period > m_pmin ? effect.period : m_pmin);
+        }
+        timer_schedule();
+    }
+}
+
+void uart_decoder::on_fx(uint8_t effect, uint8_t channel)
+{
+    // effects overlay the registers along with the ticks of
+    // the main loop, so they start there, extra ones are dropped
+    if (uint8_t(m_fxtail - m_fxhead) < sizeof(m_fxq) / sizeof(m_fxq[0]))
+    {
+        m_fxq[m_fxtail++ & (sizeof(m_fxq) / sizeof(m_fxq[0]) - 1)] = { effect, channel };
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void uart_stream::Start(PSG& psg)
+{
+    // prepare internal state
+    static uart_decoder decoder(psg);
+    static PowerSG::FxPlayer fx(psg);
+    m_decoder = &decoder;
+    m_chip = &psg;
+    m_fx = &fx;
+    m_decoder->reset();
+    m_input = false;
+    m_rsize = 0;
+    m_pending = false;
+    m_fallback = 0;
+    m_frame = timer_counts(PowerSG::tPeriod);
+    m_left = 0;
+    m_ticks = 0;
+    m_fxhead = m_fxtail = 0;
+
+    // start UART for communication
+    // and timer for PSG update
+    uart_begin(57600);
+    timer_start();
+    sei();
+}
+
+void uart_stream::SetInputHandler(Handler handler)
+{
+    if (m_decoder) m_decoder->m_handler = handler;
+}
+
+void uart_stream::SetEffects(const uint8_t* bank)
+{
+    if (m_fx) m_fx->setBank(bank);
+}
+
+void uart_stream::Update()
+{
+    // apply the frame committed by the stream
+#ifdef ENABLE_ISR_PROFILING
+    uint16_t start = TCNT1;
+    if (m_decoder->commit())
+    {
+        // pipeline and bus writes, interrupts included
+        uint16_t time = TCNT1 - start;
+        if (time > m_commit_max) m_commit_max = time;
+    }
+#else
+    m_decoder->commit();
+#endif
+
+    // start effects requested by the stream
+    while (m_fxhead != m_fxtail)
+    {
+        fx_start_t& start = m_fxq[m_fxhead & (sizeof(m_fxq) / sizeof(m_fxq[0]) - 1)];
+        if (start.effect == PowerSG::Fx_Stop) m_fx->stop(start.channel);
+        else m_fx->play(start.effect, start.channel);
+        m_fxhead++;
+    }
+
+    // play effects and queued frames, catching up with the
+    // timer, effects go along with the frame being received
+    while (m_ticks)
+    {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { m_ticks--; }
+        m_fx->tick();
+        m_decoder->tick();
+    }
+    m_chip->updateOverlay();
+
+    // send credits and replies, then switch
+    // the baud rate if it has been requested
+    m_decoder->grant();
+    uart_reply();
+    if (m_pending)
+    {
+        m_ubrr = UBRR0;
+        m_fallback = uint8_t(PowerSG::tConfirm * 1000UL / m_update);
+        uart_baud(m_switch);
+        m_pending = false;
+    }
+
+    // fall back to the previous baud rate
+    // if the new one has not been confirmed
+    if (m_fallback == 1)
+    {
+        uart_baud(m_ubrr);
+        m_fallback = 0;
+    }
+
+    if (m_input)
+    {
+        if (m_decoder->m_handler) m_decoder->m_handler(m_line);
+        m_input = false;
+    }
+
+#ifdef ENABLE_ISR_PROFILING
+    if (!m_report)
+    {
+        // worst RX interrupt and frame commit times in microseconds
+        uint16_t isr_max, overruns = m_decoder->overruns();
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            isr_max = m_isr_max; m_isr_max = 0;
+            m_report = uint8_t(1000000UL / m_update);
+        }
+        Print("isr: "); Print(uint16_t(isr_max / 2));
+        Print(" us, commit: "); Print(uint16_t(m_commit_max / 2));
+        Print(" us, overruns: "); Println(overruns);
+        m_commit_max = 0;
+    }
+#endif
+}
+
+void uart_stream::Stop()
+{
+    // stop PSG update timer and
+    // communication via UART
+    timer_stop();
+    uart_end();
+}
+
+void uart_stream::Print(char chr, int num)
+{
+    while (num-- > 0) uart_write(chr);
+}
+
+void uart_stream::Print(const char* str)
+{
+    while (*str != '\0') uart_write(*str++);
+}
+
+void uart_stream::Print(const __FlashStringHelper* str)
+{
+    const char* p = (const char *)str;
+    while (char c = pgm_read_byte(p++)) uart_write(c);
+}
+
+void uart_stream::Print(uint8_t val, bool hex)
+{
+    if (hex)
+    {
+        PrintNibble(val >> 4);
+        PrintNibble(val);
+    }
+    else
+    {
+        PrintNumber(val);
+    }
+}
+
+void uart_stream::Print(uint16_t val, bool hex)
+{
+    if (hex)
+    {
+        Print(uint8_t(val >> 8), true);
+        Print(uint8_t(val), true);
+    }
+    else
+    {
+        PrintNumber(val);
+    }
+}
+
+void uart_stream::Print(uint32_t val, bool hex)
+{
+    if (hex)
+    {
+        Print(uint16_t(val >> 16), true);
+        Print(uint16_t(val), true);
+    }
+    else
+    {
+        PrintNumber(val);
+    }
+}
+
+void uart_stream::Println(char chr, int num)
+{
+    Print(chr, num);
+    Println();
+}
+
+void uart_stream::Println(const char* str)
+{
+    Print(str);
+    Println();
+}
+
+void uart_stream::Println(const __FlashStringHelper* str)
+{
+    Print(str);
+    Println();
+}
+
+void uart_stream::Println(uint8_t val, bool hex)
+{
+    Print(val, hex);
+    Println();
+}
+
+void uart_stream::Println(uint16_t val, bool hex)
+{
+    Print(val, hex);
+    Println();
+}
+
+void uart_stream::Println(uint32_t val, bool hex)
+{
+    Print(val, hex);
+    Println();
+}
+
+void uart_stream::Println()
+{
+    uart_write('\r');
+    uart_write('\n');
+}
+
+void uart_stream::PrintNibble(uint8_t nibble)
+{
+    nibble &= 0x0F;
+    uart_write((nibble >= 0x0A ? 'A' - 0x0A : '0') + nibble);
+}
+
+void uart_stream::PrintNumber(int32_t number)
+{
+    char str[12];
+    ultoa(number, str, 10);
+    Print(str);
+}
+
+// -----------------------------------------------------------------------------
+
+ISR(USART_RX_vect)
+{
+#ifdef ENABLE_ISR_PROFILING
+    uint16_t start = TCNT1;
+#endif
+
+    // bytes lost before this one are counted for
+    // the host, the flag is valid until UDR0 is read
+    if (UCSR0A & (1 << DOR0)) m_decoder->overrun();
+
+    // decode right away, the frame commit and
+    // everything else is done by the main loop
+    m_decoder->decode(UDR0);
+
+#ifdef ENABLE_ISR_PROFILING
+    uint16_t time = TCNT1 - start;
+    if (time > m_isr_max) m_isr_max = time;
+#endif
+}
+
+ISR(TIMER1_COMPA_vect)
+{
+    for (;;)
+    {
+        uint32_t now = timer_now();
+        if (int32_t(now - m_service) >= 0)
+        {
+            // service tick, count down confirmation of the new
+            // baud rate, the main loop falls back on the last one
+            m_base = m_service;
+            m_service += timer_counts(m_update);
+            if (m_fallback > 1) m_fallback--;
+#ifdef ENABLE_ISR_PROFILING
+            if (m_report) m_report--;
+#endif
+        }
+
+        // do the writes that are due
+        uint8_t done = 0;
+        while (done < m_nwrites && int32_t(m_writes[done].due - now) <= 0)
+        {
+            m_chip->writeRegister(m_writes[done].addr, m_writes[done].data);
+            done++;
+        }
+        if (done)
+        {
+            m_nwrites -= done;
+            memmove(m_writes, m_writes + done, m_nwrites * sizeof(m_writes[0]));
+        }
+
+#ifdef ENABLE_SAMPLE_MEMORY
+        // the next sample goes straight to the volume register,
+        // late ones catch up so the sample keeps its length
+        if (m_digi && int32_t(m_ddue - now) <= 0)
+        {
+            uint8_t data = m_samples[m_dpos >> 1];
+            m_chip->writeRegister(m_dreg, (m_dpos & 1 ? data >> 4 : data & 0x0F));
+            m_ddue += m_dstep;
+            if (++m_dpos == m_dend)
+            {
+                m_dpos = m_dstart;
+                m_digi = m_dloop;
+            }
+        }
+#endif
+
+        // SID voice toggles the volume, sync buzzer restarts the
+        // envelope by writing its shape along with the mode bits
+        for (effect_state_t& fx : m_effects)
+        {
+            if (fx.step && int32_t(fx.due - now) <= 0)
+            {
+                fx.on = !fx.on;
+                uint8_t data = (fx.sid ? (fx.on ? fx.data : 0x00) : (fx.data | m_chip->getChipMode()));
+                m_chip->writeRegister(fx.reg, data);
+                fx.due += fx.step;
+            }
+        }
+
+        // the compare must be ahead of the timer,
+        // otherwise it is missed for the whole range
+        timer_schedule();
+        if (int16_t(OCR1A - TCNT1) > 0) break;
+    }
+}
+
+ISR(TIMER1_COMPB_vect)
+{
+    // schedule the next step of playback, periods
+    // longer than the timer range take a few steps
+    bool play = !m_left;
+    if (play) m_left = m_frame;
+    uint16_t step = (m_left > 0x8000 ? 0x8000 : uint16_t(m_left));
+    OCR1B += step; m_left -= step;
+
+    // frames are played by the main loop
+    if (play) m_ticks++;
+}
@@ -0,0 +1,278 @@
+#include "AsyncDevice.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace AYMHost
+{
+    // retry of an update deferred by bytes in the port only,
+    // their drain gives no event of the port to wait for
+    constexpr uint32_t retry_us = 1000;
+
+    static uint64_t now_us()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+    }
+
+    AsyncDevice::queue_driver::queue_driver(AsyncDevice& device)
+        : streaming(false)
+        , m_device(device)
+    {}
+
+    void AsyncDevice::queue_driver::chip_set_clock(uint32_t clock)
+    {
+        // the real clock is set during the setup, later changes only
+        // touch the clock of the music that is converted on the host
+        if (!streaming) linux_driver::chip_set_clock(clock);
+    }
+
+    bool AsyncDevice::queue_driver::transmit(const uint8_t* data, uint16_t size)
+    {
+        // blocking writes are used during the setup only
+        return (streaming ? m_device.enqueue(data, size) : linux_driver::transmit(data, size));
+    }
+
+    AsyncDevice::AsyncDevice()
+        : m_driver(*this)
+        , m_psg(m_driver)
+        , m_loop(nullptr)
+        , m_retry(timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK))
+        , m_queued(0)
+        , m_written(0)
+        , m_head(0)
+        , m_tail(0)
+        , m_frame(0)
+        , m_backlog(256)
+        , m_deferred(false)
+        , m_stats()
+    {
+        m_queue.reserve(4096);
+    }
+
+    AsyncDevice::~AsyncDevice()
+    {
+        close();
+        if (m_retry >= 0) ::close(m_retry);
+    }
+
+    bool AsyncDevice::open(const char* path, uint32_t baud)
+    {
+        close();
+        if (!m_driver.open(path, baud)) return false;
+
+        m_psg.begin();
+
+        // pace writes by credits of the device if it supports them
+        m_driver.set_credit(true);
+
+        int fd = m_driver.serial().fd();
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        m_driver.streaming = true;
+        return true;
+    }
+
+    void AsyncDevice::close()
+    {
+        if (m_loop && fd() >= 0) m_loop->remove(fd());
+        if (m_loop && m_retry >= 0) m_loop->remove(m_retry);
+        m_loop = nullptr;
+        m_driver.streaming = false;
+        m_driver.close();
+        m_queue.clear();
+        m_queued = m_written = 0;
+        m_head = m_tail = 0;
+        m_deferred = false;
+    }
+
+    bool AsyncDevice::attach(EventLoop& loop)
+    {
+        m_loop = &loop;
+        return loop.add(fd(), events(), [this](uint32_t events) { handle(events); })
+            && loop.add(m_retry, EPOLLIN, [this](uint32_t) { handle(0); });
+    }
+
+    int AsyncDevice::fd() const
+    {
+        return const_cast<queue_driver&>(m_driver).serial().fd();
+    }
+
+    int AsyncDevice::retryFd() const
+    {
+        return m_retry;
+    }
+
+    uint32_t AsyncDevice::events() const
+    {
+        return (EPOLLIN | EPOLLOUT | EPOLLET);
+    }
+
+    void AsyncDevice::handle(uint32_t events)
+    {
+        if (events & EPOLLIN)
+        {
+            // only credit grants are expected from the device
+            // in raw mode, the rest of its output is dropped
+            uint8_t buffer[256];
+            for (ssize_t n; (n = read(fd(), buffer, sizeof(buffer))) > 0;)
+            {
+                m_driver.input(buffer, size_t(n));
+            }
+        }
+
+        // the retry timer may have expired, it's rearmed if needed
+        uint64_t count;
+        if (m_retry >= 0 && read(m_retry, &count, sizeof(count)) < 0) count = 0;
+        write_queue();
+        if (m_deferred) update();
+    }
+
+    void AsyncDevice::onSubmission(Submission submission)
+    {
+        m_submission = std::move(submission);
+    }
+
+    void AsyncDevice::onCompletion(Completion completion)
+    {
+        m_completion = std::move(completion);
+    }
+
+    void AsyncDevice::onTelemetry(Telemetry telemetry)
+    {
+        m_telemetry = std::move(telemetry);
+    }
+
+    void AsyncDevice::setBacklog(uint32_t bytes)
+    {
+        m_backlog = bytes;
+    }
+
+    PowerSG::ChipId AsyncDevice::getChipId() const
+    {
+        // detected during the setup, cached since then
+        return m_psg.getChipId();
+    }
+
+    void AsyncDevice::setClock(PowerSG::Clock clock)
+    {
+        m_psg.setClock(clock);
+    }
+
+    void AsyncDevice::setStereo(PowerSG::Stereo stereo)
+    {
+        m_psg.setStereo(stereo);
+    }
+
+    void AsyncDevice::setRegister(PowerSG::Reg reg, PowerSG::rdata_t data)
+    {
+        m_psg.setRegister(reg, data);
+    }
+
+    uint32_t AsyncDevice::update()
+    {
+        // the link is behind, keep the changes in the input state
+        // of the pipeline, so they go out with the next frame
+        uint32_t pending = (m_head - m_tail);
+        if (m_queued - m_written + port_backlog() > m_backlog || pending == 64)
+        {
+            if (!m_deferred) m_stats.coalesced++;
+            m_deferred = true;
+
+            // with the send queue written out, the port only has
+            // the bytes, no event comes when the kernel sends them
+            if (m_queued == m_written) arm_retry();
+            return 0;
+        }
+        m_deferred = false;
+
+        uint64_t queued = m_queued;
+        m_psg.update();
+        if (m_queued == queued) return 0;
+
+        pending_t& frame = m_pending[m_head++ & 63];
+        if (++m_frame == 0) ++m_frame;
+        frame.id = m_frame;
+        frame.end = m_queued;
+        frame.time = now_us();
+        m_stats.submitted++;
+        if (m_submission) m_submission(frame.id);
+
+        write_queue();
+        return frame.id;
+    }
+
+    bool AsyncDevice::enqueue(const uint8_t* data, uint16_t size)
+    {
+        m_queue.insert(m_queue.end(), data, data + size);
+        m_queued += size;
+        return true;
+    }
+
+    void AsyncDevice::write_queue()
+    {
+        size_t offset = size_t(m_queue.size() - (m_queued - m_written));
+        while (offset < m_queue.size() && m_driver.credit())
+        {
+            size_t size = m_queue.size() - offset;
+            if (size > m_driver.credit()) size = m_driver.credit();
+
+            ssize_t n = write(fd(), m_queue.data() + offset, size);
+            if (n <= 0)
+            {
+                if (n < 0 && errno == EINTR) continue;
+                break;
+            }
+            offset += n;
+            m_written += n;
+            m_driver.spend(uint32_t(n));
+        }
+
+        // drop written bytes from the front of the queue
+        if (offset == m_queue.size())
+        {
+            m_queue.clear();
+        }
+        else if (offset > m_queue.size() / 2)
+        {
+            m_queue.erase(m_queue.begin(), m_queue.begin() + offset);
+        }
+
+        bool progress = false;
+        uint64_t time = now_us();
+        while (m_tail != m_head && m_pending[m_tail & 63].end <= m_written)
+        {
+            const pending_t& frame = m_pending[m_tail++ & 63];
+            m_stats.completed++;
+            m_stats.latency = uint32_t(time - frame.time);
+            if (m_completion) m_completion(frame.id);
+            progress = true;
+        }
+
+        if (progress && m_telemetry)
+        {
+            m_stats.backlog = uint32_t(m_queued - m_written) + port_backlog();
+            m_telemetry(m_stats);
+        }
+    }
+
+    void AsyncDevice::arm_retry()
+    {
+        itimerspec its {};
+        its.it_value.tv_nsec = long(retry_us) * 1000;
+        if (m_retry >= 0) timerfd_settime(m_retry, 0, &its, nullptr);
+    }
+
+    uint32_t AsyncDevice::port_backlog() const
+    {
+        // bytes accepted by the kernel but not yet sent
+        int outq = 0;
+        if (ioctl(fd(), TIOCOUTQ, &outq)) outq = 0;
+        return uint32_t(outq);
+    }
+}
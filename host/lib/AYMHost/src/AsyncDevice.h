@@ -0,0 +1,111 @@
+#pragma once
+
+#include <PowerSG.h>
+#include "EventLoop.h"
+
+namespace AYMHost
+{
+    // Non-blocking front-end of one AYM Streamer with the interface
+    // of PowerSG::Advanced. The pipeline runs on the host through the
+    // serial-link driver, but its output goes to a send queue that is
+    // drained by the event loop, so update() never blocks the thread.
+    // When the link falls behind, updates are deferred and coalesced
+    // into the next frame instead of growing the latency. Writes are
+    // paced by credits of the device, so its RX buffer never overflows.
+    class AsyncDevice
+    {
+    public:
+        struct telemetry_t
+        {
+            uint32_t submitted; // frames passed to the send queue
+            uint32_t completed; // frames fully written to the port
+            uint32_t coalesced; // updates merged into the next frame
+            uint32_t backlog;   // bytes waiting in send queue and port
+            uint32_t latency;   // submit to write time of last frame (us)
+        };
+
+        using Submission = std::function<void(uint32_t frame)>;
+        using Completion = std::function<void(uint32_t frame)>;
+        using Telemetry  = std::function<void(const telemetry_t& telemetry)>;
+
+        AsyncDevice();
+        ~AsyncDevice();
+
+        // blocking setup: probe the device, detect chip, then
+        // switch the port to non-blocking mode for streaming
+        bool open(const char* path, uint32_t baud);
+        void close();
+        bool attach(EventLoop& loop);
+
+        // integration with foreign event loops: register fd()
+        // for events() (edge triggered) and retryFd() for EPOLLIN,
+        // and call handle() on the events of either of them
+        int fd() const;
+        int retryFd() const;
+        uint32_t events() const;
+        void handle(uint32_t events);
+
+        // submission reports ids of all frames including the deferred
+        // ones, which handle() sends later when the link catches up
+        void onSubmission(Submission submission);
+        void onCompletion(Completion completion);
+        void onTelemetry(Telemetry telemetry);
+        void setBacklog(uint32_t bytes);
+
+        PowerSG::ChipId getChipId() const;
+        void setClock(PowerSG::Clock clock);
+        void setStereo(PowerSG::Stereo stereo);
+        void setRegister(PowerSG::Reg reg, PowerSG::rdata_t data);
+
+        // returns id of the submitted frame or 0 if deferred
+        uint32_t update();
+
+    private:
+        class queue_driver : public PowerSG::linux_driver
+        {
+        public:
+            queue_driver(AsyncDevice& device);
+            void chip_set_clock(uint32_t clock) override;
+            bool streaming;
+
+        protected:
+            bool transmit(const uint8_t* data, uint16_t size) override;
+
+        private:
+            AsyncDevice& m_device;
+        };
+
+        struct pending_t
+        {
+            uint32_t id;
+            uint64_t end;
+            uint64_t time;
+        };
+
+        bool enqueue(const uint8_t* data, uint16_t size);
+        void write_queue();
+        uint32_t port_backlog() const;
+        void arm_retry();
+
+    private:
+        queue_driver m_driver;
+        PowerSG::Advanced m_psg;
+        EventLoop* m_loop;
+        int m_retry;
+
+        std::vector<uint8_t> m_queue;
+        uint64_t m_queued;
+        uint64_t m_written;
+        pending_t m_pending[64];
+        uint32_t m_head;
+        uint32_t m_tail;
+        uint32_t m_frame;
+        uint32_t m_backlog;
+        bool m_deferred;
+
+        Submission  m_submission;
+        Completion  m_completion;
+        Telemetry   m_telemetry;
+        telemetry_t m_stats;
+    };
+}
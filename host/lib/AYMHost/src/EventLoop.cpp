@@ -0,0 +1,100 @@
+#include "EventLoop.h"
+
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace AYMHost
+{
+    EventLoop::EventLoop()
+        : m_epoll(epoll_create1(EPOLL_CLOEXEC))
+        , m_stop(false)
+    {}
+
+    EventLoop::~EventLoop()
+    {
+        for (auto entry : m_entries) delete entry;
+        for (auto entry : m_removed) delete entry;
+        if (m_epoll >= 0) close(m_epoll);
+    }
+
+    bool EventLoop::add(int fd, uint32_t events, Handler handler)
+    {
+        auto entry = new entry_t { fd, std::move(handler) };
+        epoll_event ev {};
+        ev.events = events;
+        ev.data.ptr = entry;
+
+        if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev))
+        {
+            delete entry;
+            return false;
+        }
+        m_entries.push_back(entry);
+        return true;
+    }
+
+    void EventLoop::remove(int fd)
+    {
+        for (auto it = m_entries.begin(); it != m_entries.end(); ++it)
+        {
+            if ((*it)->fd != fd) continue;
+            // handler may be removed while events are being
+            // dispatched, so it is released after the dispatch
+            epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
+            (*it)->fd = -1;
+            m_removed.push_back(*it);
+            m_entries.erase(it);
+            break;
+        }
+    }
+
+    int EventLoop::addTimer(uint32_t period_us, Timer timer)
+    {
+        int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        timespec period { time_t(period_us / 1000000), long(period_us % 1000000) * 1000 };
+        itimerspec its { period, period };
+
+        if (fd < 0 || timerfd_settime(fd, 0, &its, nullptr) ||
+            !add(fd, EPOLLIN, [fd, timer](uint32_t)
+            {
+                // run once per expiration, so late ticks are caught up
+                uint64_t count = 0;
+                if (read(fd, &count, sizeof(count)) != sizeof(count)) return;
+                while (count--) timer();
+            }))
+        {
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    bool EventLoop::poll(int timeout)
+    {
+        epoll_event events[16];
+        int count = epoll_wait(m_epoll, events, 16, timeout);
+        if (count < 0) return (errno == EINTR);
+
+        for (int i = 0; i < count; ++i)
+        {
+            auto entry = static_cast<entry_t*>(events[i].data.ptr);
+            if (entry->fd >= 0) entry->handler(events[i].events);
+        }
+        for (auto entry : m_removed) delete entry;
+        m_removed.clear();
+        return true;
+    }
+
+    void EventLoop::run()
+    {
+        m_stop = false;
+        while (!m_stop && poll(-1));
+    }
+
+    void EventLoop::stop()
+    {
+        m_stop = true;
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <vector>
+
+namespace AYMHost
+{
+    // Minimal epoll based event loop for driving devices, timers
+    // and other descriptors of the application on one thread.
+    class EventLoop
+    {
+    public:
+        using Handler = std::function<void(uint32_t events)>;
+        using Timer = std::function<void()>;
+
+        EventLoop();
+        ~EventLoop();
+
+        bool add(int fd, uint32_t events, Handler handler);
+        void remove(int fd);
+
+        // periodic timer, returns its descriptor or -1
+        int addTimer(uint32_t period_us, Timer timer);
+
+        // dispatch events once (timeout in ms, -1 to wait)
+        bool poll(int timeout);
+        void run();
+        void stop();
+
+    private:
+        struct entry_t
+        {
+            int fd;
+            Handler handler;
+        };
+
+        int  m_epoll;
+        bool m_stop;
+        std::vector<entry_t*> m_entries;
+        std::vector<entry_t*> m_removed;
+    };
+}
@@ -0,0 +1,134 @@
+#include "FrameRing.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace AYMHost
+{
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "ring needs lock-free atomics");
+
+    enum : uint32_t { Ring_Magic = 0x524D5941 }; // 'AYMR'
+
+    FrameRing::FrameRing()
+        : m_header(nullptr)
+        , m_frames(nullptr)
+        , m_size(0)
+    {
+        m_name[0] = 0;
+    }
+
+    FrameRing::~FrameRing()
+    {
+        close();
+    }
+
+    bool FrameRing::create(const char* name, uint32_t capacity)
+    {
+        close();
+        uint32_t count = 1;
+        while (count < capacity) count <<= 1;
+        size_t size = sizeof(header_t) + count * sizeof(PowerSG::frame_t);
+
+        int fd = -1;
+        if (name)
+        {
+            shm_unlink(name);
+            fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+            if (fd < 0 || ftruncate(fd, size))
+            {
+                if (fd >= 0) ::close(fd);
+                shm_unlink(name);
+                return false;
+            }
+            strncpy(m_name, name, sizeof(m_name) - 1);
+        }
+        if (!map(fd, size)) return false;
+
+        // publish the header last, so the producer that
+        // attaches early never sees half-initialized ring
+        m_header->capacity = count;
+        m_header->record = sizeof(PowerSG::frame_t);
+        m_header->head.store(0, std::memory_order_relaxed);
+        m_header->tail.store(0, std::memory_order_relaxed);
+        m_header->magic.store(Ring_Magic, std::memory_order_release);
+        return true;
+    }
+
+    bool FrameRing::attach(const char* name)
+    {
+        close();
+        int fd = shm_open(name, O_RDWR, 0);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) || size_t(st.st_size) < sizeof(header_t))
+        {
+            if (fd >= 0) ::close(fd);
+            return false;
+        }
+        if (!map(fd, st.st_size)) return false;
+
+        // the rest of the header is read after the magic
+        if (m_header->magic.load(std::memory_order_acquire) != Ring_Magic || m_header->record != sizeof(PowerSG::frame_t) ||
+            sizeof(header_t) + m_header->capacity * sizeof(PowerSG::frame_t) > m_size)
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void FrameRing::close()
+    {
+        if (m_header) munmap(m_header, m_size);
+        if (m_name[0]) shm_unlink(m_name);
+        m_header = nullptr;
+        m_frames = nullptr;
+        m_size = 0;
+        m_name[0] = 0;
+    }
+
+    bool FrameRing::push(const PowerSG::frame_t& frame)
+    {
+        uint32_t head = m_header->head.load(std::memory_order_relaxed);
+        uint32_t tail = m_header->tail.load(std::memory_order_acquire);
+        if (head - tail == m_header->capacity) return false;
+
+        m_frames[head & (m_header->capacity - 1)] = frame;
+        m_header->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool FrameRing::pop(PowerSG::frame_t& frame)
+    {
+        uint32_t tail = m_header->tail.load(std::memory_order_relaxed);
+        uint32_t head = m_header->head.load(std::memory_order_acquire);
+        if (head == tail) return false;
+
+        frame = m_frames[tail & (m_header->capacity - 1)];
+        m_header->tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    uint32_t FrameRing::size() const
+    {
+        return (m_header->head.load(std::memory_order_acquire) - m_header->tail.load(std::memory_order_acquire));
+    }
+
+    bool FrameRing::map(int fd, size_t size)
+    {
+        int flags = (fd < 0 ? MAP_SHARED | MAP_ANONYMOUS : MAP_SHARED);
+        void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, fd, 0);
+        if (fd >= 0) ::close(fd);
+        if (mem == MAP_FAILED)
+        {
+            close();
+            return false;
+        }
+        m_header = static_cast<header_t*>(mem);
+        m_frames = reinterpret_cast<PowerSG::frame_t*>(m_header + 1);
+        m_size = size;
+        return true;
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <PowerSG.h>
+#include <stddef.h>
+#include <atomic>
+
+namespace AYMHost
+{
+    // Single-producer/single-consumer lock-free ring of register
+    // frames placed in shared memory. The consumer (streamer) creates
+    // the ring, the producer (emulator, tracker) attaches to it by name.
+    // Both sides only touch memory, no syscalls after setup; the ring
+    // without name lives in an anonymous mapping for in-process use.
+    class FrameRing
+    {
+        struct header_t
+        {
+            std::atomic<uint32_t> magic; // published last by consumer
+            uint32_t capacity;
+            uint32_t record;
+            alignas(64) std::atomic<uint32_t> head; // written by producer
+            alignas(64) std::atomic<uint32_t> tail; // written by consumer
+        };
+
+    public:
+        FrameRing();
+        ~FrameRing();
+
+        // capacity is rounded up to the power of two
+        bool create(const char* name, uint32_t capacity);
+        bool attach(const char* name);
+        void close();
+
+        // producer side, returns false if the ring is full
+        bool push(const PowerSG::frame_t& frame);
+
+        // consumer side, returns false if the ring is empty
+        bool pop(PowerSG::frame_t& frame);
+        uint32_t size() const;
+
+    private:
+        bool map(int fd, size_t size);
+
+    private:
+        header_t* m_header;
+        PowerSG::frame_t* m_frames;
+        size_t m_size;
+        char m_name[64];
+    };
+}
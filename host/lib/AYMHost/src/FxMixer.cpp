@@ -0,0 +1,168 @@
+#include "FxMixer.h"
+
+#include <string.h>
+
+using namespace PowerSG;
+
+namespace AYMHost
+{
+    namespace
+    {
+        constexpr uint32_t bit(uint8_t reg) { return (UINT32_C(1) << reg); }
+        constexpr raddr_t mixer_reg = raddr_t(Reg::Mixer);
+        constexpr raddr_t noise_reg = raddr_t(Reg::N_Period);
+        constexpr raddr_t volume_reg = raddr_t(Reg::A_Volume);
+        constexpr uint32_t bank_a = (bit(BankA_Lst + 1) - 1);
+    }
+
+    FxMixer::FxMixer()
+    {
+        reset();
+    }
+
+    void FxMixer::reset()
+    {
+        memset(m_slots, 0, sizeof(m_slots));
+        memset(m_priority, 0, sizeof(m_priority));
+        memset(&m_music, 0, sizeof(m_music));
+        memset(&m_sent, 0, sizeof(m_sent));
+        for (int8_t& holder : m_holder) holder = -1;
+        m_music.regs[mixer_reg] = 0xFF;
+        m_first = true;
+    }
+
+    void FxMixer::setPriority(uint8_t channel, uint8_t priority)
+    {
+        if (channel < 3) m_priority[channel] = priority;
+    }
+
+    void FxMixer::setMusic(const frame_t& frame)
+    {
+        for (raddr_t addr = BankA_Fst; addr <= BankB_Lst; ++addr)
+        {
+            if (frame.changed & bit(addr)) m_music.regs[addr] = frame.regs[addr];
+        }
+        m_music.changed |= frame.changed;
+    }
+
+    int FxMixer::play(uint32_t id, uint8_t priority, const voice_t& voice)
+    {
+        slot_t* slot = nullptr;
+        slot_t* free = nullptr;
+        for (slot_t& s : m_slots)
+        {
+            if (s.used && s.id == id) { slot = &s; break; }
+            if (!s.used && !free) free = &s;
+        }
+
+        if (!slot)
+        {
+            if (!free) return -1;
+            slot = free;
+            slot->used = true;
+            slot->id = id;
+            slot->age = 0;
+            slot->channel = -1;
+        }
+        slot->priority = priority;
+        slot->voice = voice;
+        slot->played = true;
+
+        // the effect that has lost its channel tries again
+        if (slot->channel < 0)
+        {
+            slot->channel = int8_t(allocate(priority));
+            if (slot->channel >= 0)
+            {
+                int8_t& holder = m_holder[slot->channel];
+                if (holder >= 0) m_slots[holder].channel = -1;
+                holder = int8_t(slot - m_slots);
+            }
+        }
+        return slot->channel;
+    }
+
+    int FxMixer::allocate(uint8_t priority)
+    {
+        // free channel with the music of the lowest priority
+        // (and the quietest of them), otherwise the channel of
+        // the effect of the lowest priority (and the oldest)
+        int best = -1;
+        for (int ch = 0; ch < 3; ++ch)
+        {
+            if (m_holder[ch] >= 0 || m_priority[ch] >= priority) continue;
+            if (best < 0 || m_priority[ch] < m_priority[best] || (m_priority[ch] == m_priority[best] &&
+                (m_music.regs[volume_reg + ch] & 0x1F) < (m_music.regs[volume_reg + best] & 0x1F)))
+            {
+                best = ch;
+            }
+        }
+        if (best >= 0) return best;
+
+        for (int ch = 0; ch < 3; ++ch)
+        {
+            if (m_holder[ch] < 0) continue;
+            const slot_t& held = m_slots[m_holder[ch]];
+            if (held.priority >= priority) continue;
+            if (best < 0) { best = ch; continue; }
+            const slot_t& other = m_slots[m_holder[best]];
+            if (held.priority < other.priority || (held.priority == other.priority && held.age > other.age))
+            {
+                best = ch;
+            }
+        }
+        return best;
+    }
+
+    bool FxMixer::tick(frame_t& frame)
+    {
+        // effects that have not been played are over
+        for (slot_t& slot : m_slots)
+        {
+            if (!slot.used) continue;
+            if (slot.played)
+            {
+                slot.played = false;
+                slot.age++;
+                continue;
+            }
+            if (slot.channel >= 0) m_holder[slot.channel] = -1;
+            slot.used = false;
+        }
+
+        frame = m_music;
+        frame.changed = 0;
+        int noise = -1;
+        for (int ch = 0; ch < 3; ++ch)
+        {
+            if (m_holder[ch] < 0) continue;
+            const slot_t& slot = m_slots[m_holder[ch]];
+            const voice_t& voice = slot.voice;
+
+            frame.regs[raddr_t(Reg::A_Fine) + 2 * ch] = rdata_t(voice.tone);
+            frame.regs[raddr_t(Reg::A_Coarse) + 2 * ch] = rdata_t(voice.tone >> 8);
+            frame.regs[volume_reg + ch] = voice.volume;
+
+            // tone and noise bits of the channel, I/O bits stay
+            rdata_t bits = (0x09 << ch);
+            rdata_t data = ((voice.tone_on ? 0x00 : 0x01) | (voice.noise_on ? 0x00 : 0x08)) << ch;
+            frame.regs[mixer_reg] = ((frame.regs[mixer_reg] & ~bits) | data);
+
+            if (voice.noise_on && (noise < 0 || slot.priority > m_slots[m_holder[noise]].priority)) noise = ch;
+        }
+        if (noise >= 0) frame.regs[noise_reg] = m_slots[m_holder[noise]].voice.noise;
+
+        // changes of bank A against the last frame sent, envelope
+        // shape written by the music restarts the envelope, bank B
+        // goes as the music has changed it
+        for (raddr_t addr = BankA_Fst; addr <= BankA_Lst; ++addr)
+        {
+            if (frame.regs[addr] != m_sent.regs[addr] || m_first) frame.changed |= bit(addr);
+        }
+        frame.changed |= (m_music.changed & (bit(Mode_Bank) | ~bank_a));
+        m_music.changed = 0;
+        m_first = false;
+        m_sent = frame;
+        return (frame.changed != 0);
+    }
+}
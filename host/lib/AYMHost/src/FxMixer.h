@@ -0,0 +1,73 @@
+#pragma once
+
+#include <PowerSG.h>
+
+namespace AYMHost
+{
+    // Sound effect on one channel for a tick: tone period, volume
+    // (with envelope bit), noise period and tone/noise enable.
+    struct voice_t
+    {
+        uint16_t tone;
+        uint8_t  volume;
+        uint8_t  noise;
+        bool     tone_on;
+        bool     noise_on;
+    };
+
+    // Mixer of the music register stream with any number of sound
+    // effect streams into one frame per tick. A new effect takes a
+    // channel whose music has lower priority and no effect on it, or
+    // steals the channel of the effect of the lowest priority below
+    // its own; it keeps the channel for as long as it is played every
+    // tick. The effect channel gets its tone period, volume and tone
+    // and noise bits of the mixer, the noise period goes to the noise
+    // effect of the highest priority. State is of fixed size, mixing
+    // allocates nothing and takes a few hundred operations per tick.
+    class FxMixer
+    {
+        struct slot_t
+        {
+            uint32_t id;
+            uint32_t age;
+            voice_t  voice;
+            uint8_t  priority;
+            int8_t   channel;
+            bool     used;
+            bool     played;
+        };
+
+    public:
+        enum { Max_Effects = 16 };
+
+        FxMixer();
+        void reset();
+
+        // priority of the music on the channel, effects need
+        // the higher one to take the channel (0 by default)
+        void setPriority(uint8_t channel, uint8_t priority);
+
+        // registers of the music changed since the last tick
+        void setMusic(const PowerSG::frame_t& frame);
+
+        // voice of the effect (any id) for this tick, returns the
+        // channel it plays on or -1 if there is none for it now
+        int play(uint32_t id, uint8_t priority, const voice_t& voice);
+
+        // merge music and effects played since the last tick, effects
+        // not played release their channels, returns false if there
+        // are no changes to send
+        bool tick(PowerSG::frame_t& frame);
+
+    private:
+        int allocate(uint8_t priority);
+
+    private:
+        slot_t   m_slots[Max_Effects];
+        int8_t   m_holder[3];
+        uint8_t  m_priority[3];
+        PowerSG::frame_t m_music;
+        PowerSG::frame_t m_sent;
+        bool     m_first;
+    };
+}
@@ -0,0 +1,58 @@
+#include "MuxClient.h"
+
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace AYMHost
+{
+    MuxClient::MuxClient()
+        : m_fd(-1)
+    {
+        memset(&m_packet, 0, sizeof(m_packet));
+    }
+
+    MuxClient::~MuxClient()
+    {
+        close();
+    }
+
+    bool MuxClient::open(const char* socket, const char* name)
+    {
+        close();
+        sockaddr_un addr {};
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, socket, sizeof(addr.sun_path) - 1);
+
+        m_fd = ::socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (m_fd >= 0 && connect(m_fd, (sockaddr*)&addr, sizeof(addr)) == 0)
+        {
+            memset(&m_packet, 0, sizeof(m_packet));
+            strncpy(m_packet.name, name, sizeof(m_packet.name) - 1);
+            return true;
+        }
+        close();
+        return false;
+    }
+
+    void MuxClient::close()
+    {
+        if (m_fd >= 0) ::close(m_fd);
+        m_fd = -1;
+    }
+
+    void MuxClient::setRegister(PowerSG::Reg reg, PowerSG::rdata_t data)
+    {
+        m_packet.frame.regs[uint8_t(reg)] = data;
+        m_packet.frame.changed |= (UINT32_C(1) << uint8_t(reg));
+    }
+
+    bool MuxClient::update()
+    {
+        // an empty frame keeps the client alive in the daemon
+        bool sent = (send(m_fd, &m_packet, sizeof(m_packet), 0) == sizeof(m_packet));
+        m_packet.frame.changed = 0;
+        return sent;
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <PowerSG.h>
+
+namespace AYMHost
+{
+    // datagram sent by clients to the streaming daemon,
+    // one per frame with the registers changed since last one
+    struct mux_packet_t
+    {
+        char name[16];
+        PowerSG::frame_t frame;
+    };
+
+    // Client of the streaming daemon (muxd) that shares the device
+    // between several processes. The name identifies the client in
+    // the channel ownership configuration of the daemon.
+    class MuxClient
+    {
+    public:
+        MuxClient();
+        ~MuxClient();
+
+        bool open(const char* socket, const char* name);
+        void close();
+
+        void setRegister(PowerSG::Reg reg, PowerSG::rdata_t data);
+        bool update();
+
+    private:
+        int m_fd;
+        mux_packet_t m_packet;
+    };
+}
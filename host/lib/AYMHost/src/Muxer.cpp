@@ -0,0 +1,188 @@
+#include "Muxer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace PowerSG;
+
+namespace AYMHost
+{
+    namespace
+    {
+        constexpr uint32_t bit(uint8_t reg) { return (UINT32_C(1) << reg); }
+        constexpr raddr_t mixer_reg = raddr_t(Reg::Mixer);
+
+        struct group_t
+        {
+            char     name;
+            uint32_t regs;
+            uint8_t  mixer;
+            uint8_t  volume;
+        };
+
+        const group_t groups[Muxer::Groups] =
+        {
+            { 'A', bit(0x00) | bit(0x01) | bit(0x08), 0b00001001, 0x08 },
+            { 'B', bit(0x02) | bit(0x03) | bit(0x09), 0b00010010, 0x09 },
+            { 'C', bit(0x04) | bit(0x05) | bit(0x0A), 0b00100100, 0x0A },
+            { 'N', bit(0x06),                         0b11000000, 0xFF },
+            { 'E', bit(0x0B) | bit(0x0C) | bit(0x0D), 0b00000000, 0xFF },
+        };
+    }
+
+    Muxer::Muxer()
+        : m_timeout(50), m_tick(0), m_count(0)
+    {
+        memset(m_owner, 0, sizeof(m_owner));
+        memset(m_config, 0, sizeof(m_config));
+        memset(&m_sent, 0, sizeof(m_sent));
+        for (int g = 0; g < Groups; ++g) m_owner[g] = -1;
+    }
+
+    void Muxer::setTimeout(uint32_t timeout)
+    {
+        m_timeout = timeout;
+    }
+
+    bool Muxer::configure(const char* spec)
+    {
+        for (int g = 0; g < Groups; ++g)
+        {
+            if (spec[0] == groups[g].name && spec[1] == '=' && spec[2])
+            {
+                strncpy(m_config[g], spec + 2, sizeof(m_config[g]) - 1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Muxer::receive(const char* name, const frame_t& frame)
+    {
+        client_t* client = find(name);
+        if (!client) return;
+
+        // accumulate the changes until the next tick
+        uint32_t changed = (frame.changed & (bit(BankA_Lst + 1) - 1));
+        for (raddr_t addr = BankA_Fst; addr <= BankA_Lst; ++addr)
+        {
+            if (changed & bit(addr)) client->regs[addr] = frame.regs[addr];
+        }
+        client->pending |= changed;
+        client->seen = m_tick;
+    }
+
+    bool Muxer::tick(frame_t& frame)
+    {
+        m_tick++;
+        expire();
+
+        frame = m_sent;
+        frame.changed = 0;
+        rdata_t mixer = m_sent.regs[mixer_reg];
+
+        for (int g = 0; g < Groups; ++g)
+        {
+            const group_t& group = groups[g];
+            int prev = m_owner[g];
+            int curr = elect(g);
+            client_t* owner = (curr >= 0 ? &m_clients[curr] : nullptr);
+
+            for (raddr_t addr = BankA_Fst; addr <= BankA_Lst; ++addr)
+            {
+                if (!(group.regs & bit(addr))) continue;
+
+                // silence the channels left without owner
+                rdata_t data = (owner ? owner->regs[addr] : addr == group.volume ? 0 : frame.regs[addr]);
+                bool retrigger = (addr == Mode_Bank && owner && ((owner->pending & bit(addr)) || prev != curr));
+
+                if (data != frame.regs[addr] || retrigger || m_tick == 1)
+                {
+                    frame.regs[addr] = data;
+                    frame.changed |= bit(addr);
+                }
+            }
+            mixer = (mixer & ~group.mixer) | ((owner ? owner->regs[mixer_reg] : 0xFF) & group.mixer);
+        }
+
+        if (mixer != m_sent.regs[mixer_reg] || m_tick == 1)
+        {
+            frame.regs[mixer_reg] = mixer;
+            frame.changed |= bit(mixer_reg);
+        }
+
+        for (int c = 0; c < m_count; ++c) m_clients[c].pending = 0;
+        m_sent = frame;
+        return (frame.changed != 0);
+    }
+
+    void Muxer::merge(frame_t& into, const frame_t& frame)
+    {
+        for (raddr_t addr = BankA_Fst; addr <= BankA_Lst; ++addr)
+        {
+            if (frame.changed & bit(addr)) into.regs[addr] = frame.regs[addr];
+        }
+        into.changed |= frame.changed;
+    }
+
+    Muxer::client_t* Muxer::find(const char* name)
+    {
+        char key[sizeof(client_t::name)] {};
+        memcpy(key, name, sizeof(key) - 1);
+
+        for (int c = 0; c < m_count; ++c)
+        {
+            if (!strcmp(m_clients[c].name, key)) return &m_clients[c];
+        }
+        if (m_count == Max_Clients) return nullptr;
+
+        client_t& client = m_clients[m_count++];
+        memset(&client, 0, sizeof(client));
+        memcpy(client.name, key, sizeof(key));
+        client.regs[mixer_reg] = 0xFF;
+        fprintf(stderr, "client connected: %s\n", client.name);
+        return &client;
+    }
+
+    void Muxer::expire()
+    {
+        for (int c = 0; c < m_count; ++c)
+        {
+            if (m_tick - m_clients[c].seen <= m_timeout) continue;
+            fprintf(stderr, "client timed out: %s\n", m_clients[c].name);
+
+            // move the last client into the freed slot
+            int last = --m_count;
+            for (int g = 0; g < Groups; ++g)
+            {
+                if (m_owner[g] == c) m_owner[g] = -1;
+                if (m_owner[g] == last) m_owner[g] = c;
+            }
+            m_clients[c] = m_clients[last];
+            --c;
+        }
+    }
+
+    int Muxer::elect(int g)
+    {
+        int owner = -1;
+        if (m_config[g][0])
+        {
+            // owned by the configured client only
+            for (int c = 0; c < m_count; ++c)
+            {
+                if (!strcmp(m_clients[c].name, m_config[g])) owner = c;
+            }
+        }
+        else
+        {
+            // owned by the client that changed the group last
+            owner = m_owner[g];
+            for (int c = 0; c < m_count; ++c)
+            {
+                if (m_clients[c].pending & groups[g].regs) owner = c;
+            }
+        }
+        return (m_owner[g] = owner);
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <PowerSG.h>
+
+namespace AYMHost
+{
+    // Merger of register frames of several clients (by name) into one
+    // frame per tick by ownership of channel groups: tone period, volume
+    // and mixer bits of channels A, B and C, noise period with I/O bits
+    // of the mixer (N), envelope period and shape (E). A group is owned
+    // by the configured client, otherwise by the client that changed
+    // it last; channels left without owner are silenced. Clients silent
+    // for the timeout (ticks) are dropped.
+    class Muxer
+    {
+        struct client_t
+        {
+            char     name[16];
+            PowerSG::rdata_t regs[PowerSG::BankA_Lst + 1];
+            uint32_t pending;
+            uint32_t seen;
+        };
+
+    public:
+        enum { Max_Clients = 16, Groups = 5 };
+
+        Muxer();
+        void setTimeout(uint32_t timeout);
+
+        // ownership spec "G=name", G is one of A, B, C, N, E
+        bool configure(const char* spec);
+
+        // registers changed by the client since its last frame
+        void receive(const char* name, const PowerSG::frame_t& frame);
+
+        // merge the registers of owners into the outgoing frame,
+        // returns false if there are no changes to send
+        bool tick(PowerSG::frame_t& frame);
+
+        // merge the changes of the frame into the frame not sent yet
+        static void merge(PowerSG::frame_t& into, const PowerSG::frame_t& frame);
+
+    private:
+        client_t* find(const char* name);
+        void expire();
+        int elect(int g);
+
+    private:
+        uint32_t m_timeout;
+        uint32_t m_tick;
+        client_t m_clients[Max_Clients];
+        int      m_count;
+        int      m_owner[Groups];
+        char     m_config[Groups][sizeof(client_t::name)];
+        PowerSG::frame_t m_sent;
+    };
+}
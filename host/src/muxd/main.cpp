@@ -0,0 +1,379 @@
+// Streaming daemon that shares one AYM Streamer between local clients.
+//
+// The daemon owns the serial port and receives register frames from
+// clients (see AYMHost::MuxClient) as datagrams on a single Unix socket.
+// Once per tick all pending datagrams are drained with one recvmmsg()
+// call, the latest registers of clients are merged by channel ownership
+// (see AYMHost::Muxer) and one coalesced frame is sent to the device with
+// one write(). The number of syscalls per tick does not depend on the
+// number of clients.
+// Same-host producers with high frame rates can use the shared memory
+// ring instead (see AYMHost::FrameRing), drained without any syscalls.
+//
+// Channel groups that can be owned by a client (by name):
+//   A, B, C  tone period, volume and mixer bits of the channel
+//   N        noise period and I/O bits of the mixer
+//   E        envelope period and shape
+// Groups without owner go to the client that changed them last.
+//
+// Sound effect clients (-x) send one voice on the registers of channel
+// A; while its volume is not zero it is mixed over the music on the
+// channel given by priority (see AYMHost::FxMixer), so a game can play
+// any number of effects on top of the music of another client.
+//
+// usage: muxd -d device [options]
+//   -d path   serial port of the device
+//   -b baud   serial link baud rate, the device is switched to it from
+//             its default rate by the Baud handshake (default 57600)
+//   -s path   Unix socket for clients (default /tmp/aym-muxd.sock)
+//   -r hz     frame rate (default 50)
+//   -o G=name channel group ownership, e.g. -o A=music -o C=sfx
+//   -t ticks  drop clients silent for this number of ticks (default 50)
+//   -m name   create shared memory frame ring, e.g. /aym-ring; frames
+//             from the ring come from the client with the same name
+//   -x name=p sound effect client with priority p (1-255), e.g. -x sfx=10
+//   -f        send bitmask frames instead of register/value pairs
+//   -p        send packed frames (about half the size of bitmask ones)
+//   -c        send frames in packets with CRC (not with -p)
+//   -q fill   play frames from the device queue with its own timer and
+//             keep the queue at this fill level despite clock drift
+//
+// Frames are paced by the credits of the device: a frame it has no room
+// for yet is merged into the next one. Bytes the device still loses (USART
+// overruns) and corrupted packets are queried every few seconds and printed.
+
+#include <PowerSG.h>
+#include <MuxClient.h>
+#include <FrameRing.h>
+#include <FxMixer.h>
+#include <Muxer.h>
+#include "drivers/serial/linux_driver.h"
+
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace PowerSG;
+using AYMHost::mux_packet_t;
+
+namespace
+{
+    constexpr uint32_t bit(uint8_t reg) { return (UINT32_C(1) << reg); }
+    constexpr raddr_t mixer_reg = raddr_t(Reg::Mixer);
+
+    constexpr int max_clients  = 16;
+    constexpr int batch_size   = 32;
+    constexpr int frame_max    = 4 + Packet_Max; // the largest frame sent, a full packet
+
+    volatile sig_atomic_t g_stop = 0;
+
+    class effects
+    {
+        struct fx_client_t
+        {
+            char     name[16];
+            uint8_t  priority;
+            rdata_t  regs[BankA_Lst + 1];
+            uint32_t seen;
+        };
+
+    public:
+        effects()
+            : m_timeout(50), m_tick(0), m_count(0)
+        {}
+
+        void set_timeout(uint32_t timeout)
+        {
+            m_timeout = timeout;
+        }
+
+        bool configure(const char* spec)
+        {
+            const char* eq = strchr(spec, '=');
+            if (!eq || eq == spec || size_t(eq - spec) >= sizeof(fx_client_t::name) || m_count == max_clients) return false;
+            unsigned long priority = strtoul(eq + 1, nullptr, 0);
+            if (!priority || priority > 0xFF) return false;
+
+            fx_client_t& client = m_clients[m_count++];
+            memset(&client, 0, sizeof(client));
+            memcpy(client.name, spec, eq - spec);
+            client.priority = uint8_t(priority);
+            client.regs[mixer_reg] = 0xFF;
+            return true;
+        }
+
+        // returns false if the client is not an effect one
+        bool receive(const char* name, const frame_t& frame)
+        {
+            char key[sizeof(fx_client_t::name)] {};
+            memcpy(key, name, sizeof(key) - 1);
+
+            for (int c = 0; c < m_count; ++c)
+            {
+                fx_client_t& client = m_clients[c];
+                if (strcmp(client.name, key)) continue;
+                for (raddr_t addr = BankA_Fst; addr <= BankA_Lst; ++addr)
+                {
+                    if (frame.changed & bit(addr)) client.regs[addr] = frame.regs[addr];
+                }
+                client.seen = m_tick;
+                return true;
+            }
+            return false;
+        }
+
+        // voices of the clients that sound for the tick
+        void tick(AYMHost::FxMixer& mixer)
+        {
+            m_tick++;
+            for (int c = 0; c < m_count; ++c)
+            {
+                const fx_client_t& client = m_clients[c];
+                if (!(client.regs[0x08] & 0x1F) || m_tick - client.seen > m_timeout) continue;
+
+                AYMHost::voice_t voice;
+                voice.tone     = uint16_t(client.regs[0x00] | client.regs[0x01] << 8);
+                voice.volume   = client.regs[0x08];
+                voice.noise    = client.regs[0x06];
+                voice.tone_on  = !(client.regs[mixer_reg] & 0x01);
+                voice.noise_on = !(client.regs[mixer_reg] & 0x08);
+                mixer.play(uint32_t(c), client.priority, voice);
+            }
+        }
+
+    private:
+        uint32_t    m_timeout;
+        uint32_t    m_tick;
+        fx_client_t m_clients[max_clients];
+        int         m_count;
+    };
+
+    int open_socket(const char* path)
+    {
+        sockaddr_un addr {};
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+        unlink(path);
+
+        int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if (fd < 0 || bind(fd, (sockaddr*)&addr, sizeof(addr))) return -1;
+
+        // room for a few ticks of datagrams from all clients
+        int rcvbuf = (1 << 20);
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        return fd;
+    }
+
+    int open_timer(uint32_t rate)
+    {
+        int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        // a period of 1 s does not fit into nanoseconds alone
+        long period = 1000000000L / rate;
+        timespec ts { period / 1000000000L, period % 1000000000L };
+        itimerspec its { ts, ts };
+        if (fd < 0 || timerfd_settime(fd, 0, &its, nullptr)) return -1;
+        return fd;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const char* device = nullptr;
+    const char* socket = "/tmp/aym-muxd.sock";
+    const char* ring_name = nullptr;
+    uint32_t baud = 57600, rate = 50;
+    bool masked = false;
+    bool packed = false;
+    bool checked = false;
+    unsigned long fill = 0;
+
+    static AYMHost::Muxer mux;
+    static effects fx;
+    static AYMHost::FxMixer mixer;
+    for (int c; (c = getopt(argc, argv, "d:b:s:r:o:t:m:x:fpcq:")) != -1;)
+    {
+        switch (c)
+        {
+        case 'd': device = optarg; break;
+        case 'b': baud = strtoul(optarg, nullptr, 0); break;
+        case 's': socket = optarg; break;
+        case 'r': rate = strtoul(optarg, nullptr, 0); break;
+        case 't':
+            mux.setTimeout(strtoul(optarg, nullptr, 0));
+            fx.set_timeout(strtoul(optarg, nullptr, 0));
+            break;
+        case 'm': ring_name = optarg; break;
+        case 'f': masked = true; break;
+        case 'p': packed = true; break;
+        case 'c': checked = true; break;
+        case 'q': fill = strtoul(optarg, nullptr, 0); break;
+        case 'o':
+            if (mux.configure(optarg)) break;
+            fprintf(stderr, "bad ownership: %s\n", optarg);
+            return 1;
+        case 'x':
+            if (fx.configure(optarg)) break;
+            fprintf(stderr, "bad effect client: %s\n", optarg);
+            return 1;
+        default:
+            device = nullptr;
+            optind = argc;
+            break;
+        }
+    }
+    if (!device || !rate || rate > 1000 || fill >= Queue_Size || (packed && checked))
+    {
+        fprintf(stderr, "usage: %s -d device [-b baud] [-s socket] [-r rate] "
+            "[-o group=client ...] [-t timeout] [-m ring] [-x client=priority ...] [-f] [-p] [-c] [-q fill]\n", argv[0]);
+        return 1;
+    }
+
+    // the device starts at its default rate, a faster one is
+    // switched to by the Baud command and confirmed at the new rate
+    const uint32_t default_baud = toBaudRate(Baud::B57600);
+    linux_driver driver;
+    if (!driver.open(device, default_baud)) { fprintf(stderr, "%s: no device\n", device); return 1; }
+    if (baud != default_baud)
+    {
+        Baud code = Baud::B57600;
+        for (uint8_t i = 0; i <= uint8_t(Baud::B2000000); ++i)
+        {
+            if (toBaudRate(Baud(i)) == baud) code = Baud(i);
+        }
+        if (code == Baud::B57600 || !driver.set_baud(code))
+        {
+            fprintf(stderr, "baud rate %u refused, staying at %u\n", baud, default_baud);
+        }
+    }
+    info_t info {};
+    if (packed && (!driver.get_info(info) || !(info.features & Feature_Pack)))
+    {
+        fprintf(stderr, "%s: no packed transport, sending bitmask frames\n", device);
+        packed = false;
+    }
+    linux_serial& serial = driver.serial();
+
+    int sock = open_socket(socket);
+    if (sock < 0) { perror(socket); return 1; }
+
+    int timer = open_timer(rate);
+    if (timer < 0) { perror("timer"); return 1; }
+
+    AYMHost::FrameRing ring;
+    if (ring_name && !ring.create(ring_name, 256)) { perror(ring_name); return 1; }
+    const char* ring_client = (ring_name && ring_name[0] == '/' ? ring_name + 1 : ring_name);
+
+    signal(SIGINT,  [](int) { g_stop = 1; });
+    signal(SIGTERM, [](int) { g_stop = 1; });
+
+    static mux_packet_t packets[batch_size];
+    mmsghdr msgs[batch_size];
+    iovec iovs[batch_size];
+    for (int i = 0; i < batch_size; ++i)
+    {
+        iovs[i] = { &packets[i], sizeof(mux_packet_t) };
+        msgs[i] = {};
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    uint8_t buffer[64];
+    Encoder encoder(buffer, sizeof(buffer));
+    if (fill)
+    {
+        // device plays one frame per period of its timer
+        // and trims the period to keep the queue level
+        uint32_t period = 1000000 / rate;
+        uint8_t mode[] = { uint8_t(Mode::Queued) }, sync[] = { uint8_t(fill) };
+        uint8_t args[] = { uint8_t(period), uint8_t(period >> 8), uint8_t(period >> 16), uint8_t(period >> 24) };
+        encoder.putCommand(Cmd::Mode, mode, sizeof(mode));
+        encoder.putCommand(Cmd::Period, args, sizeof(args));
+        encoder.putCommand(Cmd::Sync, sync, sizeof(sync));
+        if (!serial.write(encoder.data(), encoder.size())) { perror(device); return 1; }
+    }
+    if (!driver.set_credit(true))
+    {
+        fprintf(stderr, "%s: no credit flow control, frames are not paced\n", device);
+    }
+
+    frame_t unsent {};
+    uint32_t tick = 0;
+    uint16_t packet_errors = 0, overruns = 0;
+
+    while (!g_stop)
+    {
+        uint64_t expirations;
+        if (read(timer, &expirations, sizeof(expirations)) != sizeof(expirations)) continue;
+
+        // drain all datagrams received since the last tick
+        for (int n = batch_size; n == batch_size;)
+        {
+            n = recvmmsg(sock, msgs, batch_size, MSG_DONTWAIT, nullptr);
+            for (int i = 0; i < n; ++i)
+            {
+                if (msgs[i].msg_len != sizeof(mux_packet_t)) continue;
+                if (!fx.receive(packets[i].name, packets[i].frame)) mux.receive(packets[i].name, packets[i].frame);
+            }
+        }
+
+        // drain the shared memory ring, no syscalls involved
+        frame_t frame;
+        if (ring_name)
+        {
+            while (ring.pop(frame))
+            {
+                if (!fx.receive(ring_client, frame)) mux.receive(ring_client, frame);
+            }
+        }
+
+        // credit grants of the device, its fill level reports are not used
+        uint8_t input[256];
+        for (int n; (n = serial.read(input, sizeof(input), 0)) > 0;) driver.input(input, size_t(n));
+
+        // effects go over the music, the queue needs
+        // a frame every tick, even an empty one
+        mux.tick(frame);
+        mixer.setMusic(frame);
+        fx.tick(mixer);
+        bool changed = mixer.tick(frame);
+        AYMHost::Muxer::merge(unsent, frame);
+
+        // a frame the device has no room for waits for the next tick,
+        // packed ones are not encoded before as the model would move on
+        if ((changed || fill) && driver.credit() >= uint32_t(frame_max))
+        {
+            encoder.clear();
+            if (checked) encoder.beginPacket();
+            if (packed) encoder.putPacked(unsent);
+            else if (masked) encoder.putMasked(unsent);
+            else encoder.putFrame(unsent);
+            if (checked) encoder.endPacket();
+            if (!serial.write(encoder.data(), encoder.size()))
+            {
+                perror(device);
+                break;
+            }
+            driver.spend(encoder.size());
+            unsent.changed = 0;
+        }
+
+        // bytes still lost by the device are worth knowing about
+        uint16_t errors, lost;
+        if (++tick % (5 * rate) == 0 && driver.get_errors(errors, lost) && (errors != packet_errors || lost != overruns))
+        {
+            fprintf(stderr, "device: %u packets dropped, %u bytes overrun\n", errors, lost);
+            packet_errors = errors;
+            overruns = lost;
+        }
+    }
+
+    close(sock);
+    unlink(socket);
+    return 0;
+}
@@ -0,0 +1,179 @@
+#include "emu_driver.h"
+#include <string.h>
+
+namespace PowerSG
+{
+    const uint8_t regs_mask[16] = 
+    {
+        0xFF, 0x0F, 0xFF, 0x0F, 0xFF, 0x0F, 0x1F, 0xFF,
+        0x1F, 0x1F, 0x1F, 0xFF, 0xFF, 0x0F, 0xFF, 0xFF
+    };
+
+    const int16_t volume_table[16] = 
+    {
+           0,   150,   224,   318,   463,   676,   926,  1497,
+        1849,  2894,  3856,  4919,  6237,  7515,  9274, 10934
+    };
+
+    emu_driver::emu_driver(uint32_t fcpu, uint32_t rate)
+        : m_fcpu(fcpu)
+        , m_rate(rate)
+        , m_clock(0)
+    {
+        chip_reset();
+    }
+
+    void emu_driver::chip_power_on()
+    {
+        m_addr = 0xFF;
+    }
+
+    void emu_driver::chip_set_clock(uint32_t clock)
+    {
+        // choosing a divider for the closest clock frequency
+        uint8_t clockDiv = uint8_t(m_fcpu / clock);
+        uint32_t minClock = (m_fcpu / (clockDiv + 1));
+        uint32_t maxClock = (m_fcpu / (clockDiv + 0));
+        if (clock - minClock < maxClock - clock) clockDiv++;
+        m_clock = (m_fcpu / clockDiv);
+    }
+
+    void emu_driver::chip_get_clock(uint32_t &clock)
+    {
+        if (m_clock != 0)
+        {
+            clock = m_clock;
+        }
+    }
+
+    void emu_driver::chip_reset()
+    {
+        memset(m_regs, 0, sizeof(m_regs));
+        memset(m_t_count, 0, sizeof(m_t_count));
+        memset(m_t_out, 0, sizeof(m_t_out));
+        m_acc = 0;
+        m_n_count = 0;
+        m_n_shift = 1;
+        m_n_out = 0;
+        reset_envelope();
+    }
+
+    void emu_driver::chip_address(uint8_t addr)
+    {
+        m_addr = addr;
+    }
+
+    void emu_driver::chip_write(uint8_t data)
+    {
+        // upper address bits deselect the chip
+        if (m_addr < 0x10)
+        {
+            m_regs[m_addr] = (data & regs_mask[m_addr]);
+            if (m_addr == 0x0D) reset_envelope();
+        }
+    }
+
+    void emu_driver::chip_read(uint8_t &data)
+    {
+        // floating data bus is pulled up
+        data = (m_addr < 0x10 ? m_regs[m_addr] : 0xFF);
+    }
+
+    void emu_driver::render(int16_t* samples, size_t frames)
+    {
+        const uint32_t step = (m_clock / 8);
+        for (size_t i = 0; i < frames; ++i)
+        {
+            int32_t level[3] = { 0, 0, 0 };
+            int32_t ticks = 0;
+
+            // average the channel levels over all ticks of
+            // the clock prescaled by 8 that fall into the sample
+            for (m_acc += step; m_acc >= m_rate; m_acc -= m_rate, ++ticks)
+            {
+                tick();
+                for (int ch = 0; ch < 3; ++ch)
+                {
+                    bool t_on = (m_t_out[ch] | (m_regs[0x07] >> (0 + ch))) & 1;
+                    bool n_on = (m_n_out     | (m_regs[0x07] >> (3 + ch))) & 1;
+                    if (t_on && n_on)
+                    {
+                        uint8_t vol = m_regs[0x08 + ch];
+                        level[ch] += volume_table[vol & 0x10 ? (m_e_step ^ m_e_attack) : (vol & 0x0F)];
+                    }
+                }
+            }
+
+            if (ticks)
+            {
+                for (int ch = 0; ch < 3; ++ch) level[ch] /= ticks;
+            }
+            samples[2 * i + 0] = int16_t(level[0] + level[1] / 2);
+            samples[2 * i + 1] = int16_t(level[2] + level[1] / 2);
+        }
+    }
+
+    void emu_driver::tick()
+    {
+        // tone generators, the output flips every period,
+        // so a full wave takes 16 * TP cycles of the clock
+        for (int ch = 0; ch < 3; ++ch)
+        {
+            uint16_t period = (m_regs[2 * ch + 0] | m_regs[2 * ch + 1] << 8);
+            if (++m_t_count[ch] >= (period ? period : 1))
+            {
+                m_t_count[ch] = 0;
+                m_t_out[ch] ^= 1;
+            }
+        }
+
+        // noise generator (17-bit LFSR), shifted every 16 * NP cycles
+        uint8_t n_period = m_regs[0x06];
+        if (++m_n_count >= 2 * (n_period ? n_period : 1))
+        {
+            m_n_count = 0;
+            m_n_shift = (m_n_shift >> 1) | (((m_n_shift ^ (m_n_shift >> 3)) & 1) << 16);
+            m_n_out = (m_n_shift & 1);
+        }
+
+        // envelope generator, 16 steps of 16 * EP cycles each
+        uint16_t e_period = (m_regs[0x0B] | m_regs[0x0C] << 8);
+        if (!m_e_hold && ++m_e_count >= 2 * uint32_t(e_period ? e_period : 1))
+        {
+            m_e_count = 0;
+            if (m_e_step) 
+            {
+                m_e_step--;
+                return;
+            }
+
+            uint8_t shape = m_regs[0x0D];
+            if (!(shape & 0x08))
+            {
+                // single cycle, then silence
+                m_e_hold = true;
+                m_e_attack = 0x00;
+            }
+            else if (shape & 0x01)
+            {
+                // single cycle, then hold
+                m_e_hold = true;
+                if (shape & 0x02) m_e_attack ^= 0x0F;
+            }
+            else
+            {
+                // repeated cycles
+                if (shape & 0x02) m_e_attack ^= 0x0F;
+                m_e_step = 0x0F;
+            }
+        }
+    }
+
+    void emu_driver::reset_envelope()
+    {
+        m_e_count  = 0;
+        m_e_step   = 0x0F;
+        m_e_attack = (m_regs[0x0D] & 0x04 ? 0x0F : 0x00);
+        m_e_hold   = false;
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stddef.h>
+#include <PowerSG.h>
+
+namespace PowerSG
+{
+    // Software PSG connected the same way as the chip on the board:
+    // the clock is derived from F_CPU by an integer divider, only the
+    // registers of the selected chip (addresses 0x00-0x0F) respond
+    // and read back with the AY-3-8910 register masks.
+    class emu_driver : public Driver
+    {
+    public:
+        emu_driver(uint32_t fcpu, uint32_t rate);
+
+        void chip_power_on() override;
+        void chip_set_clock(uint32_t clock) override;
+        void chip_get_clock(uint32_t &clock) override;
+
+        void chip_reset() override;
+        void chip_address(uint8_t addr) override;
+        void chip_write(uint8_t data) override;
+        void chip_read(uint8_t &data) override;
+
+        // render interleaved 16-bit stereo samples (ABC layout)
+        void render(int16_t* samples, size_t frames);
+
+    private:
+        void tick();
+        void reset_envelope();
+
+    private:
+        uint32_t m_fcpu;
+        uint32_t m_rate;
+        uint32_t m_clock;
+        uint32_t m_acc;
+
+        uint8_t  m_addr;
+        uint8_t  m_regs[16];
+
+        uint16_t m_t_count[3];
+        uint8_t  m_t_out[3];
+        uint16_t m_n_count;
+        uint32_t m_n_shift;
+        uint8_t  m_n_out;
+        uint32_t m_e_count;
+        uint8_t  m_e_step;
+        uint8_t  m_e_attack;
+        bool     m_e_hold;
+    };
+}
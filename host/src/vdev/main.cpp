@@ -0,0 +1,632 @@
+// Virtual AYM Streamer device on a pseudo-terminal.
+//
+// Runs the stream decoder and the PowerSG::Advanced pipeline of the
+// firmware behind a software PSG and emulates the serial side of the
+// board: bytes are taken from the pty no faster than the baud rate
+// allows and decoded on arrival as by the RX interrupt, committed
+// frames update PSG in the main loop. The RX interrupt takes its time
+// for every byte, bytes that find the 2-byte FIFO of USART full are
+// lost as on the device (data overrun). Frames of the queued mode are
+// played by the emulated playback timer.
+//
+// usage: vdev [options]
+//   -l path   create a symlink to the pty slave (e.g. /tmp/ttyAYM)
+//   -o path   write raw audio (s16le, stereo) to file, '-' for stdout
+//   -b baud   serial link baud rate, 0 for unlimited (default 57600)
+//   -r size   credit window of the device (default 64)
+//   -u us     RX interrupt time per byte (default 12)
+//   -c hz     PSG clock frequency (default 1750000)
+//   -s rate   audio sample rate (default 44100)
+//   -i sec    statistics report interval (default 1)
+//   -d ppm    drift of the playback clock against the host (default 0)
+//   -x path   AYFX bank (.afb) of the sound effects started by Fx command
+//   -t        check pitch of tone, noise and envelope of the software PSG
+
+#include <PowerSG.h>
+#include "emu_driver.h"
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+namespace
+{
+    struct options_t
+    {
+        const char* link  = nullptr;
+        const char* audio = nullptr;
+        uint32_t baud     = 57600;
+        uint32_t window   = PowerSG::Hold_Size;
+        uint32_t isr      = 12;
+        uint32_t clock    = PowerSG::F1_75MHZ;
+        uint32_t rate     = 44100;
+        uint32_t interval = 1;
+        int32_t  drift    = 0;
+        const char* bank  = nullptr;
+    };
+
+    struct stats_t
+    {
+        uint64_t rx_bytes;
+        uint64_t dropped;
+        uint64_t overruns;
+        uint64_t frames;
+        uint64_t commits;
+        uint64_t played;
+        uint64_t latency_sum;
+        uint64_t latency_max;
+        uint32_t errors;
+    };
+
+    volatile sig_atomic_t g_stop = 0;
+    int g_master = -1;
+
+    uint64_t now_us()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+    }
+
+    // times the bytes waiting in the pty were first seen, so the
+    // latency counts from the write of the client, not the read
+    class pty_arrivals
+    {
+    public:
+        void poll(int fd, uint64_t now)
+        {
+            int avail = 0;
+            if (ioctl(fd, FIONREAD, &avail) == 0 && size_t(avail) > m_pending)
+            {
+                m_queue.push_back({ avail - m_pending, now });
+                m_pending = avail;
+            }
+        }
+
+        uint64_t take()
+        {
+            if (m_queue.empty()) return 0;
+            uint64_t time = m_queue.front().second;
+            if (!--m_queue.front().first) m_queue.pop_front();
+            m_pending--;
+            return time;
+        }
+
+    private:
+        std::deque<std::pair<size_t, uint64_t>> m_queue;
+        size_t m_pending = 0;
+    };
+
+    // USART of the device, bytes wait for the RX interrupt in
+    // the 2-byte FIFO, the one finding it full is lost (DOR)
+    class usart_rx
+    {
+    public:
+        usart_rx(uint32_t baud, uint32_t isr_us)
+            : m_byte(baud ? 10e6 / baud : 0), m_isr(isr_us)
+        {}
+
+        bool receive(double& line, double start, stats_t& stats)
+        {
+            // the byte is complete a byte time after the previous one
+            line = std::max(line, start) + m_byte;
+            while (!m_fifo.empty() && m_fifo.front() <= line) m_fifo.pop_front();
+            if (m_fifo.size() >= 2)
+            {
+                if (!m_overrun) stats.overruns++;
+                stats.dropped++;
+                m_overrun = true;
+                return false;
+            }
+
+            // the interrupt takes the byte once done with the previous one
+            m_free = std::max(m_free, line);
+            m_fifo.push_back(m_free);
+            m_free += m_isr;
+            m_overrun = false;
+            return true;
+        }
+
+    private:
+        double m_byte;
+        double m_isr;
+        double m_free = 0;
+        bool   m_overrun = false;
+        std::deque<double> m_fifo;
+    };
+
+    void write_all(int fd, const void* data, size_t size)
+    {
+        auto ptr = static_cast<const uint8_t*>(data);
+        while (size)
+        {
+            ssize_t n = write(fd, ptr, size);
+            if (n <= 0) return;
+            ptr += n; size -= n;
+        }
+    }
+
+    class vdev_decoder : public PowerSG::Decoder
+    {
+    public:
+        using PowerSG::Decoder::Decoder;
+        uint32_t m_baud   = 0;
+        uint32_t m_window = 0;
+        uint32_t m_period = PowerSG::tPeriod;
+        PowerSG::Advanced* m_chip = nullptr;
+        PowerSG::FxPlayer* m_fx = nullptr;
+
+        // timed writes waiting for the simulation time
+        struct timed_write_t { uint64_t due; PowerSG::raddr_t addr; PowerSG::rdata_t data; };
+        std::vector<timed_write_t> m_writes;
+        uint64_t m_now = 0;
+
+        void apply_timed(PowerSG::Advanced& psg, uint64_t now)
+        {
+            // writes are done with the step resolution (1 ms)
+            for (size_t i = 0; i < m_writes.size();)
+            {
+                if (m_writes[i].due <= now)
+                {
+                    psg.writeRegister(m_writes[i].addr, m_writes[i].data);
+                    m_writes.erase(m_writes.begin() + i);
+                }
+                else ++i;
+            }
+        }
+
+        // sample memory and playback state of digidrums
+        uint8_t  m_samples[PowerSG::Sample_Size] = {};
+        bool     m_digi  = false;
+        bool     m_dloop = false;
+        uint8_t  m_dreg  = 0;
+        uint32_t m_dpos  = 0, m_dstart = 0, m_dend = 0, m_dstep = 0;
+        uint64_t m_ddue  = 0;
+
+        // timer effects of the channels
+        struct effect_state_t { uint64_t due; uint32_t step; uint8_t reg, data; bool sid, on; };
+        effect_state_t m_effects[3] = {};
+
+        uint64_t next_event() const
+        {
+            uint64_t next = (m_digi ? m_ddue : UINT64_MAX);
+            for (const auto& fx : m_effects)
+            {
+                if (fx.step) next = std::min(next, fx.due);
+            }
+            return next;
+        }
+
+        void run_events(PowerSG::Advanced& psg, uint64_t now)
+        {
+            if (m_digi && m_ddue <= now)
+            {
+                uint8_t data = m_samples[m_dpos >> 1];
+                psg.writeRegister(m_dreg, (m_dpos & 1 ? data >> 4 : data & 0x0F));
+                m_ddue += m_dstep;
+                if (++m_dpos == m_dend)
+                {
+                    m_dpos = m_dstart;
+                    m_digi = m_dloop;
+                }
+            }
+            for (auto& fx : m_effects)
+            {
+                if (fx.step && fx.due <= now)
+                {
+                    fx.on = !fx.on;
+                    uint8_t data = (fx.sid ? (fx.on ? fx.data : 0x00) : (fx.data | psg.getChipMode()));
+                    psg.writeRegister(fx.reg, data);
+                    fx.due += fx.step;
+                }
+            }
+        }
+
+    protected:
+        void on_input_string(const char* str) override
+        {
+            // same echo as the input handler of the firmware
+            char line[80];
+            int len = snprintf(line, sizeof(line), "echo: %s\r\n", str);
+            write_all(g_master, line, len);
+        }
+
+        void on_output(const uint8_t* data, uint8_t size) override
+        {
+            write_all(g_master, data, size);
+        }
+
+        void on_info(PowerSG::info_t& info) override
+        {
+            info.version = 0x0300;
+            info.buffer  = uint16_t(m_window);
+            info.bauds   = 0b00001111; // up to 500 kbaud as the firmware
+            info.features = PowerSG::Feature_Pack | PowerSG::Feature_Samples;
+        }
+
+        void on_baud(PowerSG::Baud baud) override
+        {
+            // link never fails here, so no confirmation is needed;
+            // unlimited bandwidth stays unlimited
+            uint32_t rate = PowerSG::toBaudRate(baud);
+            if (m_baud && m_baud != rate)
+            {
+                m_baud = rate;
+                fprintf(stderr, "baud rate: %u\n", rate);
+            }
+        }
+
+        void on_period(uint32_t period) override
+        {
+            m_period = period;
+        }
+
+        void on_timed(uint16_t offset, PowerSG::raddr_t addr, PowerSG::rdata_t data) override
+        {
+            m_writes.push_back({ m_now + offset, addr, data });
+        }
+
+        void on_sample(uint16_t pos, uint8_t data) override
+        {
+            if (pos < sizeof(m_samples)) m_samples[pos] = data;
+        }
+
+        void on_digi(const PowerSG::digi_t& digi) override
+        {
+            // the same clipping and limits as in the firmware
+            uint32_t start = std::min<uint32_t>(digi.start, sizeof(m_samples));
+            uint32_t length = std::min<uint32_t>(digi.length, sizeof(m_samples) - start);
+            m_digi = (digi.channel != PowerSG::Digi_Stop && length);
+            if (m_digi)
+            {
+                m_dloop  = digi.loop;
+                m_dreg   = uint8_t(PowerSG::Reg::A_Volume) + digi.channel;
+                m_dstart = m_dpos = 2 * start;
+                m_dend   = 2 * (start + length);
+                m_dstep  = std::max<uint32_t>(digi.period, 40);
+                m_ddue   = m_now;
+            }
+        }
+
+        void on_fx(uint8_t effect, uint8_t channel) override
+        {
+            if (effect == PowerSG::Fx_Stop) m_fx->stop(channel);
+            else m_fx->play(effect, channel);
+        }
+
+        void on_effect(const PowerSG::effect_t& effect) override
+        {
+            // the same as the firmware does
+            auto& fx = m_effects[effect.channel];
+            bool sid = (effect.kind == PowerSG::Effect::Sid);
+            if (effect.kind == PowerSG::Effect::Stop)
+            {
+                if (fx.step && fx.sid) m_chip->writeRegister(fx.reg, fx.data);
+                fx.step = 0;
+                return;
+            }
+            if (!fx.step || fx.sid != sid)
+            {
+                fx.due = m_now;
+                fx.on  = false;
+            }
+            fx.sid  = sid;
+            fx.reg  = (sid ? uint8_t(PowerSG::Reg::A_Volume) + effect.channel : uint8_t(PowerSG::Reg::EA_Shape));
+            fx.data = (sid ? effect.data : effect.data & 0x0F);
+            fx.step = std::max<uint32_t>(effect.period, 40);
+        }
+    };
+
+    void report(const stats_t& stats, const stats_t& last, double seconds, bool total)
+    {
+        uint64_t frames = stats.frames - last.frames;
+        uint64_t commits = stats.commits - last.commits;
+        uint64_t lat_sum = stats.latency_sum - last.latency_sum;
+        fprintf(stderr,
+            "%s rx: %8.0f B/s  frames: %6.1f/s  played: %6.1f/s  dropped: %llu B (%llu overruns)  "
+            "latency: avg %.2f ms, max %.2f ms  bad packets: %u\n",
+            total ? "total" : "     ",
+            (stats.rx_bytes - last.rx_bytes) / seconds,
+            frames / seconds,
+            (stats.played - last.played) / seconds,
+            (unsigned long long)stats.dropped,
+            (unsigned long long)stats.overruns,
+            commits ? lat_sum / 1000.0 / commits : 0.0,
+            stats.latency_max / 1000.0,
+            stats.errors);
+    }
+
+    double rising_edges(PowerSG::emu_driver& emu, uint32_t rate, uint32_t seconds)
+    {
+        // rate of rising edges of the left channel across
+        // the half of the full volume of a single channel
+        std::vector<int16_t> samples(2 * rate);
+        uint64_t edges = 0;
+        bool high = false;
+        for (uint32_t s = 0; s < seconds; ++s)
+        {
+            emu.render(samples.data(), rate);
+            for (uint32_t i = 0; i < rate; ++i)
+            {
+                bool level = (samples[2 * i] > 10934 / 2);
+                if (level && !high) edges++;
+                high = level;
+            }
+        }
+        return double(edges) / seconds;
+    }
+
+    int check_pitch(const options_t& opt)
+    {
+        PowerSG::emu_driver emu(16000000, opt.rate);
+        uint32_t clock = 0;
+        emu.chip_set_clock(opt.clock);
+        emu.chip_get_clock(clock);
+
+        struct check_t
+        {
+            const char* name;
+            uint8_t regs[14];
+            double  expected;
+            double  tolerance;
+        };
+
+        // noise of a random bit sequence rises on every 4th shift
+        const check_t checks[] =
+        {
+            { "tone TP=256",    { 0x00, 0x01, 0, 0, 0, 0, 0x00, 0x3E, 0x0F, 0, 0, 0x00, 0x00, 0x00 },
+              clock / (16.0 * 256), 0.01 },
+            { "noise NP=31",    { 0x00, 0x00, 0, 0, 0, 0, 0x1F, 0x37, 0x0F, 0, 0, 0x00, 0x00, 0x00 },
+              clock / (16.0 * 31) / 4, 0.05 },
+            { "envelope EP=100", { 0x00, 0x00, 0, 0, 0, 0, 0x00, 0x3F, 0x10, 0, 0, 0x64, 0x00, 0x08 },
+              clock / (256.0 * 100), 0.01 },
+        };
+
+        int failed = 0;
+        for (const check_t& check : checks)
+        {
+            emu.chip_reset();
+            for (uint8_t addr = 0; addr < sizeof(check.regs); ++addr)
+            {
+                emu.chip_address(addr);
+                emu.chip_write(check.regs[addr]);
+            }
+
+            double measured = rising_edges(emu, opt.rate, 4);
+            bool ok = (measured > check.expected * (1 - check.tolerance) &&
+                       measured < check.expected * (1 + check.tolerance));
+            fprintf(stderr, "%-16s expected %8.2f Hz, measured %8.2f Hz  %s\n",
+                check.name, check.expected, measured, ok ? "ok" : "FAILED");
+            if (!ok) failed++;
+        }
+        return (failed ? 1 : 0);
+    }
+
+    int open_pty(const char* link)
+    {
+        int master = posix_openpt(O_RDWR | O_NOCTTY);
+        if (master < 0 || grantpt(master) || unlockpt(master)) return -1;
+
+        // keep the slave side open, so the master never gets
+        // EIO when a client closes the port and reopens it
+        const char* name = ptsname(master);
+        int slave = open(name, O_RDWR | O_NOCTTY);
+        if (slave < 0) return -1;
+
+        termios tio;
+        tcgetattr(slave, &tio);
+        cfmakeraw(&tio);
+        tcsetattr(slave, TCSANOW, &tio);
+
+        if (link)
+        {
+            unlink(link);
+            if (symlink(name, link)) perror("symlink");
+        }
+        fprintf(stderr, "virtual device: %s\n", link ? link : name);
+
+        fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+        return master;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    options_t opt;
+    bool check = false;
+    for (int c; (c = getopt(argc, argv, "l:o:b:r:u:c:s:i:d:x:t")) != -1;)
+    {
+        switch (c)
+        {
+        case 'l': opt.link = optarg; break;
+        case 'o': opt.audio = optarg; break;
+        case 'b': opt.baud = strtoul(optarg, nullptr, 0); break;
+        case 'r': opt.window = strtoul(optarg, nullptr, 0); break;
+        case 'u': opt.isr = strtoul(optarg, nullptr, 0); break;
+        case 'c': opt.clock = strtoul(optarg, nullptr, 0); break;
+        case 's': opt.rate = strtoul(optarg, nullptr, 0); break;
+        case 'i': opt.interval = strtoul(optarg, nullptr, 0); break;
+        case 'd': opt.drift = strtol(optarg, nullptr, 0); break;
+        case 'x': opt.bank = optarg; break;
+        case 't': check = true; break;
+        default:
+            fprintf(stderr, "usage: %s [-l link] [-o audio] [-b baud] [-r window] [-u isr_us] "
+                "[-c clock] [-s rate] [-i interval] [-d drift_ppm] [-x bank] [-t]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (opt.window > 0xFFFF || !opt.rate)
+    {
+        fprintf(stderr, "bad options\n");
+        return 1;
+    }
+    if (check) return check_pitch(opt);
+
+    int audio = -1;
+    if (opt.audio)
+    {
+        audio = (strcmp(opt.audio, "-") ? open(opt.audio, O_WRONLY | O_CREAT | O_TRUNC, 0644) : 1);
+        if (audio < 0) { perror(opt.audio); return 1; }
+    }
+
+    std::vector<uint8_t> bank;
+    if (opt.bank)
+    {
+        FILE* file = fopen(opt.bank, "rb");
+        if (!file) { perror(opt.bank); return 1; }
+        for (int c; (c = fgetc(file)) != EOF;) bank.push_back(uint8_t(c));
+        fclose(file);
+    }
+
+    g_master = open_pty(opt.link);
+    if (g_master < 0) { perror("pty"); return 1; }
+
+    signal(SIGINT,  [](int) { g_stop = 1; });
+    signal(SIGTERM, [](int) { g_stop = 1; });
+    signal(SIGPIPE, SIG_IGN);
+
+    // the same setup of PSG as in the firmware
+    static PowerSG::emu_driver driver(16000000, opt.rate);
+    static PowerSG::Advanced psg(driver);
+    static vdev_decoder decoder(psg);
+    static PowerSG::FxPlayer fx(psg);
+    if (!bank.empty()) fx.setBank(bank.data());
+    decoder.m_fx = &fx;
+    decoder.m_baud = opt.baud;
+    decoder.m_window = opt.window;
+    decoder.m_chip = &psg;
+    psg.begin();
+    psg.setClock(opt.clock);
+    psg.setStereo(PowerSG::Stereo::ABC);
+    fprintf(stderr, "chip: %08X, clock: %u Hz\n", uint32_t(psg.getChipId()), psg.getClock());
+
+    stats_t stats {}, last {};
+    pty_arrivals arrivals;
+    usart_rx usart(opt.baud, opt.isr);
+
+    // simulation runs in steps of 1 ms in real time
+    const uint64_t step_us = 1000;
+    const uint64_t start = now_us();
+    uint64_t sim_us = 0, next_report = opt.interval * 1000000ull;
+    double rx_credit = 0, audio_acc = 0, next_play = 0, line = 0;
+    uint64_t arrival = 0;
+    std::vector<int16_t> samples;
+
+    while (!g_stop)
+    {
+        uint64_t deadline = start + sim_us + step_us;
+        timespec ts { time_t(deadline / 1000000), long(deadline % 1000000 * 1000) };
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+        sim_us += step_us;
+
+        // receive bytes limited by the link bandwidth (10 bits per byte)
+        uint8_t buf[4096];
+        size_t limit = sizeof(buf);
+        if (decoder.m_baud)
+        {
+            rx_credit += decoder.m_baud / 10.0 * step_us / 1e6;
+            if (rx_credit > sizeof(buf)) rx_credit = sizeof(buf);
+            limit = size_t(rx_credit);
+        }
+        // main loop of the firmware commits the frames received so
+        // far, latency is of the first one from its arrival in the pty
+        const auto commit = [&]()
+        {
+            if (decoder.commit())
+            {
+                uint64_t latency = (arrival ? now_us() - arrival : 0);
+                arrival = 0;
+                stats.commits++;
+                stats.latency_sum += latency;
+                if (latency > stats.latency_max) stats.latency_max = latency;
+            }
+        };
+
+        arrivals.poll(g_master, now_us());
+        ssize_t received = (limit ? read(g_master, buf, limit) : 0);
+        if (received < 0) received = 0;
+        decoder.m_now = sim_us;
+        for (ssize_t i = 0; i < received; ++i)
+        {
+            // 'USART RX interrupt' decodes the stream
+            uint64_t time = arrivals.take();
+            uint64_t overruns = stats.overruns;
+            if (decoder.m_baud && !usart.receive(line, double(sim_us - step_us), stats))
+            {
+                // the device counts overruns for Errors command
+                if (stats.overruns != overruns) decoder.overrun();
+                continue;
+            }
+            if (decoder.decode(buf[i]))
+            {
+                if (!arrival) arrival = time;
+                stats.frames++;
+            }
+
+            // the main loop runs commands of the stream right away
+            if (decoder.holding()) commit();
+        }
+        stats.rx_bytes += received;
+        if (decoder.m_baud)
+        {
+            // idle line does not accumulate bandwidth
+            rx_credit -= received;
+            if (size_t(received) < limit && rx_credit > 1) rx_credit = 1;
+        }
+
+        commit();
+
+        // playback timer interrupt, effects and frames of queued mode
+        while (sim_us >= next_play)
+        {
+            next_play += decoder.m_period * (1 + opt.drift / 1e6);
+            fx.tick();
+            if (decoder.tick()) stats.played++;
+        }
+        psg.updateOverlay();
+        decoder.apply_timed(psg, sim_us);
+        decoder.grant();
+        stats.errors = decoder.errors();
+
+        // sound output of the emulated PSG, split at the writes
+        // of digidrum and effects, so that they reach PSG in time
+        const auto render = [&](uint64_t us)
+        {
+            if (audio < 0) return;
+            audio_acc += opt.rate * us / 1e6;
+            size_t frames = size_t(audio_acc);
+            audio_acc -= frames;
+            samples.resize(2 * frames);
+            driver.render(samples.data(), frames);
+            write_all(audio, samples.data(), samples.size() * sizeof(int16_t));
+        };
+        uint64_t rendered = sim_us - step_us;
+        for (uint64_t due; (due = decoder.next_event()) <= sim_us;)
+        {
+            if (due > rendered) { render(due - rendered); rendered = due; }
+            decoder.run_events(psg, due);
+        }
+        render(sim_us - rendered);
+
+        if (opt.interval && sim_us >= next_report)
+        {
+            next_report += opt.interval * 1000000ull;
+            report(stats, last, opt.interval, false);
+            last = stats;
+        }
+    }
+
+    report(stats, stats_t {}, sim_us / 1e6, true);
+    if (opt.link) unlink(opt.link);
+    return 0;
+}
@@ -0,0 +1,105 @@
+// Clock conversion of the pipeline: periods written to PSG must be
+// the periods of the music scaled by the ratio of the clocks.
+
+#include <PowerSG.h>
+#include <math.h>
+#include <string.h>
+#include <unity.h>
+
+using namespace PowerSG;
+
+namespace
+{
+    // YM2149 clocked by the 16 MHz crystal divided as on the board
+    class test_driver : public Driver
+    {
+    public:
+        uint8_t regs[16] {};
+
+        void chip_power_on() override {}
+        void chip_set_clock(uint32_t clock) override { m_clock = 16000000 / (16000000 / clock); }
+        void chip_get_clock(uint32_t& clock) override { clock = m_clock; }
+        void chip_reset() override { memset(regs, 0, sizeof(regs)); }
+        void chip_address(uint8_t addr) override { m_addr = addr & 0x0F; }
+        void chip_write(uint8_t data) override { regs[m_addr] = data; }
+        void chip_read(uint8_t& data) override { data = regs[m_addr]; }
+
+    private:
+        uint32_t m_clock = 2000000;
+        uint8_t  m_addr = 0;
+    };
+
+    // rounding, and up to 0.002 of the longest period
+    // for the ratio of the clocks in 8.24 fixed point
+#ifdef ENABLE_CONVERSION_CARRY
+    const double max_error = 1.0 + 3e-3;
+#else
+    const double max_error = 0.5 + 3e-3;
+#endif
+
+    test_driver driver;
+    Advanced psg(driver);
+
+    double check_periods(Clock clock)
+    {
+        psg.begin();
+        psg.setClock(clock);
+        double ratio = double(psg.Simple::getClock()) / clock, worst = 0;
+
+        for (uint32_t period = 1; period <= 0xFFFF; period += 7)
+        {
+            psg.setRegister(Reg::A_Fine, uint8_t(period));
+            psg.setRegister(Reg::A_Coarse, uint8_t(period >> 8) & 0x0F);
+            psg.setRegister(Reg::E_Fine, uint8_t(period));
+            psg.setRegister(Reg::E_Coarse, uint8_t(period >> 8));
+            psg.setRegister(Reg::N_Period, uint8_t(period) & 0x1F);
+            psg.update();
+
+            // converted periods are clamped to the range of registers
+            double tone = fmin((period & 0x0FFF) * ratio, 0x0FFF);
+            double envelope = fmin(period * ratio, 0xFFFF);
+            double noise = fmin((period & 0x1F) * ratio, 0x1F);
+            worst = fmax(worst, fabs((driver.regs[0] | driver.regs[1] << 8) - tone));
+            worst = fmax(worst, fabs((driver.regs[11] | driver.regs[12] << 8) - envelope));
+            worst = fmax(worst, fabs(driver.regs[6] - noise));
+        }
+        return worst;
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_same_clock()
+{
+    // 1 MHz is exact for the crystal, periods go as they are
+    TEST_ASSERT_TRUE(check_periods(1000000) == 0);
+}
+
+void test_zx_spectrum_clock()
+{
+    // 1773400 Hz is played at 16 MHz / 9
+    TEST_ASSERT_TRUE(check_periods(1773400) <= max_error);
+}
+
+void test_round_clock()
+{
+    // 1.5 MHz is played at 16 MHz / 10, 7% faster
+    TEST_ASSERT_TRUE(check_periods(1500000) <= max_error);
+}
+
+void test_distant_clock()
+{
+    // 1.1 MHz is played at 16 MHz / 14, 4% faster
+    TEST_ASSERT_TRUE(check_periods(1100000) <= max_error);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_same_clock);
+    RUN_TEST(test_zx_spectrum_clock);
+    RUN_TEST(test_round_clock);
+    RUN_TEST(test_distant_clock);
+    return UNITY_END();
+}
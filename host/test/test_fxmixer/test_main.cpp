@@ -0,0 +1,137 @@
+// Effect mixer: channel allocation against the music, stealing
+// by priority and the registers of the mixed frame.
+
+#include <FxMixer.h>
+#include <unity.h>
+
+using namespace AYMHost;
+using namespace PowerSG;
+
+namespace
+{
+    FxMixer mixer;
+
+    voice_t make_voice(uint16_t tone, bool noise_on = false)
+    {
+        voice_t voice {};
+        voice.tone = tone;
+        voice.volume = 0x0F;
+        voice.noise = 0x11;
+        voice.tone_on = true;
+        voice.noise_on = noise_on;
+        return voice;
+    }
+
+    void set_music_volumes(uint8_t a, uint8_t b, uint8_t c)
+    {
+        frame_t music {};
+        music.regs[raddr_t(Reg::A_Volume)] = a;
+        music.regs[raddr_t(Reg::B_Volume)] = b;
+        music.regs[raddr_t(Reg::C_Volume)] = c;
+        music.regs[raddr_t(Reg::Mixer)] = 0x38;
+        music.changed = (0x07 << raddr_t(Reg::A_Volume)) | (1 << raddr_t(Reg::Mixer));
+        mixer.setMusic(music);
+    }
+}
+
+void setUp()
+{
+    mixer.reset();
+}
+
+void tearDown() {}
+
+void test_quietest_channel_first()
+{
+    set_music_volumes(0x0F, 0x03, 0x08);
+    TEST_ASSERT_EQUAL(1, mixer.play(1, 10, make_voice(100)));
+    TEST_ASSERT_EQUAL(2, mixer.play(2, 10, make_voice(200)));
+    TEST_ASSERT_EQUAL(0, mixer.play(3, 10, make_voice(300)));
+
+    // the channel is kept while the effect is played
+    frame_t frame;
+    mixer.tick(frame);
+    TEST_ASSERT_EQUAL(1, mixer.play(1, 10, make_voice(100)));
+}
+
+void test_music_priority()
+{
+    // channel A is reserved for the music
+    set_music_volumes(0x00, 0x0F, 0x0F);
+    mixer.setPriority(0, 20);
+    TEST_ASSERT_EQUAL(1, mixer.play(1, 10, make_voice(100)));
+    TEST_ASSERT_EQUAL(2, mixer.play(2, 10, make_voice(200)));
+    TEST_ASSERT_EQUAL(-1, mixer.play(3, 10, make_voice(300)));
+    TEST_ASSERT_EQUAL(0, mixer.play(4, 30, make_voice(400)));
+}
+
+void test_steal_lowest_priority()
+{
+    set_music_volumes(0x01, 0x02, 0x03);
+    TEST_ASSERT_EQUAL(0, mixer.play(1, 5, make_voice(100)));
+    TEST_ASSERT_EQUAL(1, mixer.play(2, 3, make_voice(200)));
+    TEST_ASSERT_EQUAL(2, mixer.play(3, 7, make_voice(300)));
+
+    // the equal priority does not steal, the higher one takes
+    // the channel of the lowest priority effect
+    TEST_ASSERT_EQUAL(-1, mixer.play(4, 3, make_voice(400)));
+    TEST_ASSERT_EQUAL(1, mixer.play(5, 6, make_voice(500)));
+
+    // the effect that lost its channel gets one when a channel
+    // is released by the effect that was not played
+    frame_t frame;
+    mixer.tick(frame);
+    mixer.play(1, 5, make_voice(100));
+    mixer.play(5, 6, make_voice(500));
+    mixer.tick(frame);
+    TEST_ASSERT_EQUAL(2, mixer.play(2, 3, make_voice(200)));
+}
+
+void test_steal_oldest_of_equal()
+{
+    set_music_volumes(0x01, 0x02, 0x03);
+    frame_t frame;
+    mixer.play(1, 5, make_voice(100));
+    mixer.tick(frame);
+    mixer.play(1, 5, make_voice(100));
+    mixer.play(2, 5, make_voice(200));
+    mixer.play(3, 5, make_voice(300));
+    TEST_ASSERT_EQUAL(0, mixer.play(4, 9, make_voice(400)));
+}
+
+void test_mixed_frame()
+{
+    set_music_volumes(0x05, 0x06, 0x0F);
+    mixer.play(1, 10, make_voice(0x1234, true));
+    frame_t frame;
+    TEST_ASSERT_TRUE(mixer.tick(frame));
+
+    // the effect replaces tone and volume of channel A,
+    // its tone and noise bits and the noise period
+    TEST_ASSERT_EQUAL_HEX8(0x34, frame.regs[raddr_t(Reg::A_Fine)]);
+    TEST_ASSERT_EQUAL_HEX8(0x12, frame.regs[raddr_t(Reg::A_Coarse)]);
+    TEST_ASSERT_EQUAL_HEX8(0x0F, frame.regs[raddr_t(Reg::A_Volume)]);
+    TEST_ASSERT_EQUAL_HEX8(0x06, frame.regs[raddr_t(Reg::B_Volume)]);
+    TEST_ASSERT_EQUAL_HEX8(0x30, frame.regs[raddr_t(Reg::Mixer)]);
+    TEST_ASSERT_EQUAL_HEX8(0x11, frame.regs[raddr_t(Reg::N_Period)]);
+
+    // nothing changes while the effect plays on
+    mixer.play(1, 10, make_voice(0x1234, true));
+    TEST_ASSERT_FALSE(mixer.tick(frame));
+
+    // the music gets its registers back after the effect
+    TEST_ASSERT_TRUE(mixer.tick(frame));
+    TEST_ASSERT_EQUAL_HEX8(0x05, frame.regs[raddr_t(Reg::A_Volume)]);
+    TEST_ASSERT_EQUAL_HEX8(0x38, frame.regs[raddr_t(Reg::Mixer)]);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_quietest_channel_first);
+    RUN_TEST(test_music_priority);
+    RUN_TEST(test_steal_lowest_priority);
+    RUN_TEST(test_steal_oldest_of_equal);
+    RUN_TEST(test_mixed_frame);
+    return UNITY_END();
+}
@@ -0,0 +1,124 @@
+// Client merger of the streaming daemon: channel groups by owner,
+// silence after timeout and the frames held back by credits.
+
+#include <Muxer.h>
+#include <unity.h>
+
+using namespace AYMHost;
+using namespace PowerSG;
+
+namespace
+{
+    constexpr raddr_t mixer_reg = raddr_t(Reg::Mixer);
+
+    frame_t make_frame(uint32_t changed, uint8_t value, uint8_t mixer = 0x38)
+    {
+        frame_t frame {};
+        for (raddr_t addr = BankA_Fst; addr <= BankA_Lst; ++addr) frame.regs[addr] = value;
+        frame.regs[mixer_reg] = mixer;
+        frame.changed = changed;
+        return frame;
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_last_change_owns_group()
+{
+    Muxer mux;
+    frame_t frame;
+
+    // music sets all channels, the game changes channel C only
+    mux.receive("music", make_frame(0x3FFF, 0x11));
+    mux.receive("game", make_frame((1 << 4) | (1 << 5) | (1 << 10) | (1 << mixer_reg), 0x22, 0x00));
+    TEST_ASSERT_TRUE(mux.tick(frame));
+    TEST_ASSERT_EQUAL_HEX8(0x11, frame.regs[0x08]);
+    TEST_ASSERT_EQUAL_HEX8(0x22, frame.regs[0x0A]);
+    TEST_ASSERT_EQUAL_HEX8(0x22, frame.regs[0x04]);
+
+    // mixer bits come from the owners of their groups
+    TEST_ASSERT_EQUAL_HEX8(0x18, frame.regs[mixer_reg]);
+
+    // nothing new, nothing to send
+    mux.receive("music", make_frame(0, 0x11));
+    mux.receive("game", make_frame(0, 0x22));
+    TEST_ASSERT_FALSE(mux.tick(frame));
+}
+
+void test_configured_owner()
+{
+    Muxer mux;
+    TEST_ASSERT_TRUE(mux.configure("A=sfx"));
+    TEST_ASSERT_FALSE(mux.configure("X=sfx"));
+
+    // channel A stays silent until its owner sends
+    frame_t frame;
+    mux.receive("music", make_frame(0x3FFF, 0x11));
+    mux.tick(frame);
+    TEST_ASSERT_EQUAL_HEX8(0x00, frame.regs[0x08]);
+    TEST_ASSERT_EQUAL_HEX8(0x11, frame.regs[0x09]);
+
+    mux.receive("sfx", make_frame(1 << 8, 0x0F));
+    mux.receive("music", make_frame(0x3FFF, 0x12));
+    TEST_ASSERT_TRUE(mux.tick(frame));
+    TEST_ASSERT_EQUAL_HEX8(0x0F, frame.regs[0x08]);
+    TEST_ASSERT_EQUAL_HEX8(0x12, frame.regs[0x09]);
+}
+
+void test_timeout_silences_channels()
+{
+    Muxer mux;
+    mux.setTimeout(3);
+    frame_t frame;
+    mux.receive("music", make_frame(0x3FFF, 0x0F));
+    mux.tick(frame);
+    TEST_ASSERT_EQUAL_HEX8(0x0F, frame.regs[0x09]);
+
+    for (int t = 0; t < 2; ++t) mux.tick(frame);
+    TEST_ASSERT_EQUAL_HEX8(0x0F, frame.regs[0x09]);
+    TEST_ASSERT_TRUE(mux.tick(frame));
+    TEST_ASSERT_EQUAL_HEX8(0x00, frame.regs[0x08]);
+    TEST_ASSERT_EQUAL_HEX8(0x00, frame.regs[0x09]);
+    TEST_ASSERT_EQUAL_HEX8(0x00, frame.regs[0x0A]);
+    TEST_ASSERT_EQUAL_HEX8(0xFF, frame.regs[mixer_reg]);
+}
+
+void test_envelope_shape_retriggers()
+{
+    Muxer mux;
+    frame_t frame;
+    mux.receive("music", make_frame(0x3FFF, 0x0E));
+    mux.tick(frame);
+
+    // the same shape written again restarts the envelope
+    mux.receive("music", make_frame(1 << Mode_Bank, 0x0E));
+    TEST_ASSERT_TRUE(mux.tick(frame));
+    TEST_ASSERT_EQUAL_HEX32(1 << Mode_Bank, frame.changed);
+}
+
+void test_merge_unsent()
+{
+    // frames the device had no credit for go out with the next one
+    frame_t unsent {};
+    frame_t first = make_frame((1 << 0) | (1 << 8), 0x11);
+    frame_t second = make_frame((1 << 8) | (1 << 9), 0x22);
+    Muxer::merge(unsent, first);
+    Muxer::merge(unsent, second);
+    TEST_ASSERT_EQUAL_HEX32((1 << 0) | (1 << 8) | (1 << 9), unsent.changed);
+    TEST_ASSERT_EQUAL_HEX8(0x11, unsent.regs[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x22, unsent.regs[8]);
+    TEST_ASSERT_EQUAL_HEX8(0x22, unsent.regs[9]);
+    TEST_ASSERT_EQUAL_HEX8(0x00, unsent.regs[1]);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_last_change_owns_group);
+    RUN_TEST(test_configured_owner);
+    RUN_TEST(test_timeout_silences_channels);
+    RUN_TEST(test_envelope_shape_retriggers);
+    RUN_TEST(test_merge_unsent);
+    return UNITY_END();
+}
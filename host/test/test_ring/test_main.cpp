@@ -0,0 +1,113 @@
+// Frame ring: order, capacity and the shared memory handshake
+// between the consumer that creates the ring and the producer.
+
+#include <FrameRing.h>
+#include <thread>
+#include <unity.h>
+
+using namespace AYMHost;
+using PowerSG::frame_t;
+
+namespace
+{
+    const char* ring_name = "/aym-test-ring";
+
+    frame_t make_frame(uint32_t n)
+    {
+        frame_t frame {};
+        frame.regs[0] = uint8_t(n);
+        frame.regs[1] = uint8_t(n >> 8);
+        frame.changed = n;
+        return frame;
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_order_and_capacity()
+{
+    // capacity is rounded up to the power of two
+    FrameRing ring;
+    TEST_ASSERT_TRUE(ring.create(nullptr, 5));
+    frame_t frame;
+    TEST_ASSERT_FALSE(ring.pop(frame));
+
+    // the indices wrap around a few times
+    uint32_t pushed = 0, popped = 0;
+    for (int round = 0; round < 5; ++round)
+    {
+        while (ring.push(make_frame(pushed))) pushed++;
+        TEST_ASSERT_EQUAL(8, ring.size());
+        for (int i = 0; i < 5; ++i)
+        {
+            TEST_ASSERT_TRUE(ring.pop(frame));
+            TEST_ASSERT_EQUAL(popped++, frame.changed);
+        }
+    }
+    while (ring.pop(frame)) TEST_ASSERT_EQUAL(popped++, frame.changed);
+    TEST_ASSERT_EQUAL(pushed, popped);
+    TEST_ASSERT_EQUAL(0, ring.size());
+}
+
+void test_attach_by_name()
+{
+    FrameRing producer;
+    TEST_ASSERT_FALSE(producer.attach(ring_name));
+
+    FrameRing consumer;
+    TEST_ASSERT_TRUE(consumer.create(ring_name, 16));
+    TEST_ASSERT_TRUE(producer.attach(ring_name));
+    TEST_ASSERT_TRUE(producer.push(make_frame(42)));
+
+    frame_t frame;
+    TEST_ASSERT_TRUE(consumer.pop(frame));
+    TEST_ASSERT_EQUAL(42, frame.changed);
+
+    // the name is gone with the consumer
+    consumer.close();
+    FrameRing late;
+    TEST_ASSERT_FALSE(late.attach(ring_name));
+}
+
+void test_producer_thread()
+{
+    FrameRing consumer, producer;
+    TEST_ASSERT_TRUE(consumer.create(ring_name, 64));
+    TEST_ASSERT_TRUE(producer.attach(ring_name));
+
+    const uint32_t count = 100000;
+    std::thread thread([&]()
+    {
+        for (uint32_t n = 0; n < count;)
+        {
+            if (producer.push(make_frame(n))) n++;
+            else std::this_thread::yield();
+        }
+    });
+
+    // frames come whole and in order
+    uint32_t bad = 0;
+    for (uint32_t n = 0; n < count;)
+    {
+        frame_t frame;
+        if (!consumer.pop(frame))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        if (frame.changed != n || frame.regs[0] != uint8_t(n) || frame.regs[1] != uint8_t(n >> 8)) bad++;
+        n++;
+    }
+    thread.join();
+    TEST_ASSERT_EQUAL(0, bad);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_order_and_capacity);
+    RUN_TEST(test_attach_by_name);
+    RUN_TEST(test_producer_thread);
+    return UNITY_END();
+}
@@ -0,0 +1,257 @@
+// Stream protocol: frames put by the encoder come out of the
+// decoder as the registers of the pipeline, replies go back.
+
+#include <PowerSG.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+using namespace PowerSG;
+
+namespace
+{
+    // register file of YM2149 with bank B of AY8930 beside it
+    class test_driver : public Driver
+    {
+    public:
+        void chip_power_on() override {}
+        void chip_set_clock(uint32_t clock) override { m_clock = clock; }
+        void chip_get_clock(uint32_t& clock) override { clock = m_clock; }
+        void chip_reset() override { memset(m_regs, 0, sizeof(m_regs)); }
+        void chip_address(uint8_t addr) override { m_addr = addr & 0x0F; }
+        void chip_write(uint8_t data) override { m_regs[m_addr] = data; }
+        void chip_read(uint8_t& data) override { data = m_regs[m_addr]; }
+
+    private:
+        uint32_t m_clock = 1750000;
+        uint8_t  m_addr = 0;
+        uint8_t  m_regs[16] {};
+    };
+
+    class test_decoder : public Decoder
+    {
+    public:
+        using Decoder::Decoder;
+        uint8_t reply[32];
+        uint8_t size = 0;
+
+    protected:
+        void on_output(const uint8_t* data, uint8_t length) override
+        {
+            memcpy(reply + size, data, length);
+            size += length;
+        }
+    };
+
+    test_driver driver;
+    Advanced psg(driver);
+    test_decoder decoder(psg);
+    uint8_t buffer[256];
+    Encoder encoder(buffer, sizeof(buffer));
+
+    void feed()
+    {
+        // the device commits from its main loop after every byte
+        for (uint16_t i = 0; i < encoder.size(); ++i)
+        {
+            decoder.decode(buffer[i]);
+            decoder.commit();
+        }
+        encoder.clear();
+    }
+
+    frame_t make_frame(uint32_t changed, uint8_t seed)
+    {
+        frame_t frame {};
+        for (raddr_t addr = BankA_Fst; addr <= BankB_Lst; ++addr)
+        {
+            frame.regs[addr] = uint8_t(seed + 7 * addr);
+        }
+        frame.regs[uint8_t(Reg::Mode_Bank)] = 0x0E;
+        frame.changed = changed;
+        return frame;
+    }
+
+    void check_frame(const frame_t& frame)
+    {
+        for (raddr_t addr = BankA_Fst; addr <= BankB_Lst; ++addr)
+        {
+            if (!(frame.changed & (UINT32_C(1) << addr))) continue;
+            rdata_t data;
+            psg.getRegister(Reg(addr), data);
+            TEST_ASSERT_EQUAL_HEX8(frame.regs[addr], data);
+        }
+    }
+}
+
+void setUp()
+{
+    psg.begin();
+    decoder.reset();
+    decoder.size = 0;
+    encoder.clear();
+}
+
+void tearDown() {}
+
+void test_pairs_frame()
+{
+    frame_t frame = make_frame(0x1FFF, 0x11);
+    TEST_ASSERT_TRUE(encoder.putFrame(frame));
+    feed();
+    check_frame(frame);
+}
+
+void test_masked_frame_bank_a()
+{
+    frame_t frame = make_frame(0x2A55, 0x23);
+    TEST_ASSERT_TRUE(encoder.putMasked(frame));
+    TEST_ASSERT_EQUAL_HEX8(uint8_t(Cmd::Frame16), buffer[0]);
+    TEST_ASSERT_EQUAL(3 + 7, encoder.size());
+    feed();
+    check_frame(frame);
+}
+
+void test_masked_frame_bank_b()
+{
+    frame_t frame = make_frame(0x05F00003, 0x35);
+    TEST_ASSERT_TRUE(encoder.putMasked(frame));
+    TEST_ASSERT_EQUAL_HEX8(uint8_t(Cmd::Frame32), buffer[0]);
+    feed();
+    check_frame(frame);
+}
+
+void test_frames_merge_until_commit()
+{
+    // the second frame arrives before the main loop has run
+    frame_t first = make_frame(0x0003, 0x40), second = make_frame(0x0300, 0x50);
+    encoder.putMasked(first);
+    encoder.putMasked(second);
+    for (uint16_t i = 0; i < encoder.size(); ++i) decoder.decode(buffer[i]);
+    encoder.clear();
+    TEST_ASSERT_TRUE(decoder.commit());
+    TEST_ASSERT_FALSE(decoder.commit());
+    check_frame(first);
+    check_frame(second);
+}
+
+void test_info_reply()
+{
+    encoder.putCommand(Cmd::Info);
+    feed();
+    TEST_ASSERT_EQUAL(1 + Info_Size, decoder.size);
+    TEST_ASSERT_EQUAL_HEX8(uint8_t(Cmd::Info), decoder.reply[0]);
+    TEST_ASSERT_EQUAL(uint16_t(Hold_Size), decoder.reply[11] | decoder.reply[12] << 8);
+#ifdef ENABLE_PACKED_TRANSPORT
+    TEST_ASSERT_TRUE(decoder.reply[14] & Feature_Pack);
+#endif
+}
+
+void test_read_reply()
+{
+    uint8_t args[] = { 0x03, 0x5A };
+    encoder.putCommand(Cmd::Write, args, sizeof(args));
+    encoder.putCommand(Cmd::Read, args, 1);
+    feed();
+    TEST_ASSERT_EQUAL(2, decoder.size);
+    TEST_ASSERT_EQUAL_HEX8(uint8_t(Cmd::Read), decoder.reply[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x5A, decoder.reply[1]);
+}
+
+void test_crc16()
+{
+    // check value of CRC-16/XMODEM
+    uint16_t crc = 0;
+    for (const char* p = "123456789"; *p; ++p) crc = crc16(crc, uint8_t(*p));
+    TEST_ASSERT_EQUAL_HEX16(0x31C3, crc);
+}
+
+void test_checked_packets()
+{
+    frame_t first = make_frame(0x0007, 0x80), second = make_frame(0x0070, 0x90);
+    encoder.beginPacket();
+    encoder.putMasked(first);
+    TEST_ASSERT_TRUE(encoder.endPacket());
+    feed();
+    check_frame(first);
+
+    // the corrupted packet is dropped along with the garbage after
+    // it, the decoder gets back in sync on the next packet header
+    frame_t bad = make_frame(0x0070, 0xA0);
+    encoder.beginPacket();
+    encoder.putMasked(bad);
+    encoder.endPacket();
+    buffer[4] ^= 0x01;
+    encoder.putRegister(0x0C, 0x33);
+    encoder.putFrame();
+    encoder.beginPacket();
+    encoder.putMasked(second);
+    encoder.endPacket();
+    feed();
+    TEST_ASSERT_EQUAL(1, decoder.errors());
+    check_frame(second);
+    rdata_t data;
+    psg.getRegister(Reg(0x0C), data);
+    TEST_ASSERT_TRUE(data != 0x33);
+
+    // empty packet returns to the plain stream
+    encoder.beginPacket();
+    encoder.endPacket();
+    encoder.putMasked(first);
+    feed();
+    check_frame(first);
+}
+
+#ifdef ENABLE_PACKED_TRANSPORT
+void test_packed_frames()
+{
+    // random walks of the registers, so the model finds recently
+    // used masks and values as well as deltas and literals
+    frame_t frame = make_frame(0, 0x60);
+    uint16_t packed = 0, masked = 0;
+    srand(38);
+    for (int n = 0; n < 500; ++n)
+    {
+        frame.changed = 0;
+        for (raddr_t addr = BankA_Fst; addr <= BankA_Lst; ++addr)
+        {
+            if (addr == uint8_t(Reg::Mode_Bank) || rand() % 3) continue;
+            frame.regs[addr] += uint8_t(rand() % 4 ? rand() % 7 - 3 : rand());
+            frame.changed |= (UINT32_C(1) << addr);
+        }
+        uint8_t masked_buffer[64];
+        Encoder masked_encoder(masked_buffer, sizeof(masked_buffer));
+        masked_encoder.putMasked(frame);
+        masked += masked_encoder.size();
+
+        TEST_ASSERT_TRUE(encoder.putPacked(frame));
+        packed += encoder.size();
+        feed();
+        check_frame(frame);
+    }
+    TEST_ASSERT_TRUE(packed < masked);
+
+    // the next plain frame leaves the packed transport
+    frame = make_frame(0x0007, 0x70);
+    encoder.putMasked(frame);
+    feed();
+    check_frame(frame);
+}
+#endif
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_pairs_frame);
+    RUN_TEST(test_masked_frame_bank_a);
+    RUN_TEST(test_masked_frame_bank_b);
+    RUN_TEST(test_frames_merge_until_commit);
+    RUN_TEST(test_info_reply);
+    RUN_TEST(test_read_reply);
+    RUN_TEST(test_crc16);
+    RUN_TEST(test_checked_packets);
+#ifdef ENABLE_PACKED_TRANSPORT
+    RUN_TEST(test_packed_frames);
+#endif
+    return UNITY_END();
+}